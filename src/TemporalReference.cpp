@@ -579,7 +579,7 @@ namespace scidb4geo
 
 
 
-    int TReference::indexAtDatetime ( TPoint &t )
+    int64_t TReference::indexAtDatetime ( TPoint &t )
     {
         TInterval dif;
 
@@ -627,7 +627,7 @@ namespace scidb4geo
         else if ( _r == DAY ) result =  d;
         else result =  tt;
 
-        return ( int ) result;
+        return ( int64_t ) result;
 
     }
 
@@ -277,7 +277,7 @@ namespace scidb4geo {
         * @param t The TPoint representation of a certain date/time
         * @return int The nearest index for the given date/time
         */
-        int indexAtDatetime(TPoint& t);
+        int64_t indexAtDatetime(TPoint& t);
 
     protected:
         /** the temporal datum */
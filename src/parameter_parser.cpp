@@ -27,11 +27,15 @@ ParameterParser::ParameterParser(string scidbFile, char** optionKVP, SciDBOperat
     _propKeyResolver.mapping = map_list_of("dt", TRS)("timestamp", TIMESTAMP)(
         "t", TIMESTAMP)("type", TYPE)("i", T_INDEX)("bbox", BBOX)("srs", SRS)(
         "CHUNKSIZE_SP", CHUNKSIZE_SPATIAL)("chunksize_sp", CHUNKSIZE_SPATIAL)(
-        "CHUNKSIZE_T", CHUNKSIZE_TEMPORAL)("chunksize_t", CHUNKSIZE_TEMPORAL);
+        "CHUNKSIZE_T", CHUNKSIZE_TEMPORAL)("chunksize_t", CHUNKSIZE_TEMPORAL)(
+        "reducer", REDUCER)("apply", APPLY)("filter", FILTER)(
+        "occupancy", OCCUPANCY)("version", VERSION)("mask", MASK)("align", ALIGN)("blocksize", BLOCKSIZE)(
+        "request_mb", REQUEST_MB)("cache_mb", CACHE_MB)("cache_mode", CACHE_MODE)(
+        "warm_cache", WARM_CACHE);
 
     _conKeyResolver.mapping = map_list_of("host", HOST)("port", PORT)(
         "user", USER)("password", PASSWORD)("ssl", SSL)("trust", SSLTRUST)("array", ARRAY)(
-        "confirmDelete", CONFIRM_DELETE);
+        "confirmDelete", CONFIRM_DELETE)("query", QUERY);
 
     _scidb_filename = scidbFile;
     _options = optionKVP;
@@ -41,9 +45,17 @@ ParameterParser::ParameterParser(string scidbFile, char** optionKVP, SciDBOperat
 }
 
 void ParameterParser::parseConnectionString() {
+    // AFL queries contain whitespace and '=', they take the remainder of the connection string
+    string connstr = _connection_string;
+    size_t qpos = connstr.find("query=");
+    if (qpos != string::npos) {
+        _con->query = boost::algorithm::trim_copy(connstr.substr(qpos + 6));
+        connstr = connstr.substr(0, qpos);
+    }
+
     vector<string> connparts;
     // Split at whitespace, comma, semicolon
-    boost::split(connparts, _connection_string, boost::is_any_of("; "));
+    boost::split(connparts, connstr, boost::is_any_of("; "));
     for (vector<string>::iterator it = connparts.begin(); it != connparts.end();
          ++it) {
         vector<string> kv;
@@ -220,16 +232,14 @@ void ParameterParser::parsePropertiesString() {
                         // interval
                         vector<string> attr;
                         boost::split(attr, t_interval, boost::is_any_of(":"));
-                        _query->lower_bound = boost::lexical_cast<int>(attr[0]);
-                        _query->upper_bound = boost::lexical_cast<int>(attr[1]);
-                        // TODO for now we parse it correctly, but we will just use the
-                        // lower_bound... change this later
-                        Utils::debug("Currently interval query is not supported. Using the "
-                                    "lower bound instead");
-                        _query->temp_index = _query->lower_bound;
+                        _query->lower_bound = boost::lexical_cast<int64_t>(attr[0]);
+                        _query->upper_bound = boost::lexical_cast<int64_t>(attr[1]);
+                        // each temporal index of the interval becomes a separate band
+                        _query->hasTemporalRange = true;
+                        _query->hasTemporalIndex = false;
                     } else {
                         // temporal index
-                        _query->temp_index = boost::lexical_cast<int>(t_interval);
+                        _query->temp_index = boost::lexical_cast<int64_t>(t_interval);
                     }
                     if (_query->temp_index > 0) {
                         _query->hasTemporalIndex = true;
@@ -342,8 +352,18 @@ void ParameterParser::parsePropertiesString() {
             case SSLTRUST:
                 _con->ssltrust = CSLTestBoolean(value.c_str());
                 break;
-            case ARRAY:
-                _con->arrayname = value;
+            case ARRAY: {
+                // further arrays on the same grid are listed comma separated, e.g. array=refl,qa
+                size_t bpos = value.find('[');
+                string names = value.substr(0, bpos);
+                vector<string> parts;
+                boost::split(parts, names, boost::is_any_of(","));
+                _con->arrayname = parts[0] + ((bpos == string::npos) ? "" : value.substr(bpos));
+                _con->joinarrays.assign(parts.begin() + 1, parts.end());
+                break;
+            }
+            case QUERY:
+                _con->query = value;
                 break;
             case CONFIRM_DELETE:
                 boost::algorithm::to_lower<string>(value);
@@ -416,6 +436,11 @@ void ParameterParser::parsePropertiesString() {
                     throw ERR_GLOBAL_PARSE;
                 }
                 break;
+            case WARM_CACHE:
+                _create->warmCache = CSLTestBoolean(value.c_str());
+                break;
+            default:
+                break;
         }
     }
     void ParameterParser::assignQueryParameter(string key, string value) {
@@ -424,13 +449,122 @@ void ParameterParser::parsePropertiesString() {
             case T_INDEX:
                 // this T_INDEX is for query only!
                 Utils::debug("Assign query parameter for temporal index");
-                _query->temp_index = boost::lexical_cast<int>(value);
+                _query->temp_index = boost::lexical_cast<int64_t>(value);
                 _query->hasTemporalIndex = true;
                 // TODO maybe we allow also selecting multiple slices (that will later be
                 // saved separately as individual files)
                 break;
+            case TIMESTAMP: {
+                // either a single temporal index, a single timestamp or an interval of both separated by '/'
+                vector<string> range;
+                boost::split(range, value, boost::is_any_of("/"));
+                try {
+                    if (range.size() == 2) {
+                        if (isTimestamp(range[0]) && isTimestamp(range[1])) {
+                            _query->timestamp = range[0];
+                            _query->timestamp_end = range[1];
+                        } else {
+                            _query->lower_bound = boost::lexical_cast<int64_t>(range[0]);
+                            _query->upper_bound = boost::lexical_cast<int64_t>(range[1]);
+                        }
+                        _query->hasTemporalRange = true;
+                        _query->hasTemporalIndex = false;
+                    } else if (isTimestamp(value)) {
+                        _query->timestamp = value;
+                        _query->hasTemporalIndex = false;
+                    } else {
+                        _query->temp_index = boost::lexical_cast<int64_t>(value);
+                        _query->hasTemporalIndex = true;
+                    }
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::error("Cannot interpret temporal query '" + value + "'. Please use either a temporal index, an ISO 8601 "
+                                 "timestamp or an interval of those separated by '/'");
+                    throw ERR_GLOBAL_PARSE;
+                }
+                break;
+            }
+            case REDUCER: {
+                boost::algorithm::to_lower<string>(value);
+                if (value != "min" && value != "max" && value != "mean" && value != "median" && value != "latest") {
+                    Utils::error("Unknown reducer '" + value + "'. Please use 'min', 'max', 'mean', 'median' or 'latest'.");
+                    throw ERR_GLOBAL_PARSE;
+                }
+                _query->reducer = value;
+                break;
+            }
+            case APPLY: {
+                // name:expression, the expression itself may contain colons
+                size_t pos = value.find(":");
+                if (pos == string::npos || pos == 0 || pos == value.length() - 1) {
+                    Utils::error("Cannot interpret apply expression '" + value + "'. Please use 'name:expression'.");
+                    throw ERR_GLOBAL_PARSE;
+                }
+                _query->apply_names.push_back(boost::algorithm::trim_copy(value.substr(0, pos)));
+                _query->apply_exprs.push_back(value.substr(pos + 1));
+                break;
+            }
+            case FILTER: {
+                // repeated filters must all hold
+                if (_query->filter.empty())
+                    _query->filter = value;
+                else
+                    _query->filter = "(" + _query->filter + ") and (" + value + ")";
+                break;
+            }
+            case OCCUPANCY:
+                _query->useOccupancy = CSLTestBoolean(value.c_str());
+                break;
+            case MASK:
+                _query->useMask = CSLTestBoolean(value.c_str());
+                break;
+            case ALIGN:
+                _query->alignBlocks = CSLTestBoolean(value.c_str());
+                break;
+            case BLOCKSIZE:
+                try {
+                    _query->blockSize = boost::lexical_cast<int>(value);
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::warn("Cannot parse block size '" + value + "', block size is derived automatically");
+                    _query->blockSize = -1;
+                }
+                break;
+            case CACHE_MODE:
+                _query->cacheMode = boost::algorithm::to_upper_copy(value);
+                if (_query->cacheMode != "SHARED" && _query->cacheMode != "GDAL") {
+                    Utils::warn("Unknown cache mode '" + value + "', using default");
+                    _query->cacheMode = "";
+                }
+                break;
+            case CACHE_MB:
+                try {
+                    _query->cacheMB = boost::lexical_cast<double>(value);
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::warn("Cannot parse cache size '" + value + "', using default");
+                    _query->cacheMB = -1;
+                }
+                break;
+            case REQUEST_MB:
+                try {
+                    _query->requestMB = boost::lexical_cast<double>(value);
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::warn("Cannot parse request size '" + value + "', using default");
+                    _query->requestMB = SCIDB4GDAL_DEFAULT_REQUEST_MB;
+                }
+                break;
+            case VERSION:
+                try {
+                    _query->version = boost::lexical_cast<int64_t>(value);
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::error("Cannot interpret array version '" + value + "'");
+                    throw ERR_GLOBAL_PARSE;
+                }
+                break;
             default:
                 break;
         }
     }
+
+    bool ParameterParser::isTimestamp(string s) {
+        return s.length() >= 10 && Utils::validateTimestampString(s);
+    }
 }
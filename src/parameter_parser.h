@@ -183,6 +183,14 @@ namespace scidb4gdal
         */
         static void loadParsFromEnv(ConnectionParameters* con);
 
+        /**
+        * @brief checks whether a string is a complete ISO 8601 date / time string
+        *
+        * @param s the string to be checked
+        * @return bool
+        */
+        static bool isTimestamp(string s);
+
       private:
         /**
         * pointer to the connection parameters
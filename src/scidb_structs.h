@@ -34,6 +34,8 @@ namespace scidb4gdal {
         string name;
         /** the name of the data type that the values will represent */
         string typeId;
+        /** the data type of the attribute in the stored array if it differs from typeId, e.g. for averaged composites, empty otherwise */
+        string sourceTypeId;
         /** a flag if the attribute is allowed to have null values */
         bool nullable;
         /** metadata about the domain of the attribute */
@@ -88,10 +90,16 @@ namespace scidb4gdal {
     */
     struct SciDBArray {
         
+        SciDBArray() : version(0) {}
+
         virtual ~SciDBArray() {};
         
         /** the name of the array under which it is (or will be) stored in SciDB */
         string name;
+        /** the array version that is read, 0 if reads are not pinned to a version */
+        int64_t version;
+        /** expressions of further arrays on the same grid that are joined to this array, their attributes follow in attrs */
+        vector<string> joins;
         /** a list of scidb4gdal::Attribute that contain metadata about the attributes */
         vector<SciDBAttribute> attrs;
         /** a list of scidb4gdal::Dimension that contain metadata about the dimensions */
@@ -565,7 +573,7 @@ namespace scidb4gdal {
             _x_idx = 0;
             _y_idx = 1;
             if (xdim != "" && ydim != "") {
-                for (size_t i = 0; i < dims.size(); ++i) { // Assuming 2 dimensions!!!
+                for (size_t i = 0; i < dims.size(); ++i) { // further dimensions are only exposed by the multidimensional API
                     if (dims[i].name == xdim)
                         _x_idx = i;
                     if (dims[i].name == ydim)
@@ -573,7 +581,7 @@ namespace scidb4gdal {
                 }
                 // TODO: Assert x_idx != y_idx
             } else {                                       // Try default dimension names
-                for (size_t i = 0; i < dims.size(); ++i) { // Assuming 2 dimensions!!!
+                for (size_t i = 0; i < dims.size(); ++i) { // further dimensions are only exposed by the multidimensional API
                     if (dims[i].name == SCIDB4GDAL_DEFAULT_XDIMNAME)
                         _x_idx = i;
                     if (dims[i].name == SCIDB4GDAL_DEFAULT_YDIMNAME)
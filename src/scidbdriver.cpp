@@ -30,14 +30,21 @@ SOFTWARE.
 #include <boost/lexical_cast.hpp>
 #include <boost/assign.hpp>
 #include <limits.h>
+#include <algorithm>
 #include "shim_client_structs.h"
 #include "scidb_structs.h"
 #include "parameter_parser.h"
+#include "scidbmultidim.h"
 
 CPL_C_START
 void GDALRegister_SciDB(void);
 CPL_C_END
 
+/**
+ * Releases the process-wide tile cache when the driver is unloaded
+ */
+static void SciDBUnloadDriver(GDALDriver*) { scidb4gdal::SharedTileCache::destroy(); }
+
 /**
  * GDAL driver registration function
  * Links the specific functions for Open, Identify, Delete and Create Copy on a
@@ -50,6 +57,9 @@ void GDALRegister_SciDB() {
         poDriver = new GDALDriver();
         poDriver->SetDescription("SciDB");
         poDriver->SetMetadataItem(GDAL_DCAP_RASTER, "YES");
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 1, 0)
+        poDriver->SetMetadataItem(GDAL_DCAP_MULTIDIM_RASTER, "YES");
+#endif
         std::stringstream driverlongname;
         driverlongname << "SciDB array driver(" << "BUILD " << __DATE__ << " " << __TIME__ << ")";
         poDriver->SetMetadataItem(GDAL_DMD_LONGNAME, driverlongname.str().c_str());
@@ -83,12 +93,33 @@ void GDALRegister_SciDB() {
         co_descr << "    <Option name='srs' type='string'  description='spatial reference system (deprecated)'/>";
         co_descr << "    <Option name='t' type='string'  description='datetime as ISO8601 string'/>";
         co_descr << "    <Option name='dt' type='string' description='temporal resolution as ISO8601 period string'/>";
+        co_descr << "    <Option name='warm_cache' type='boolean' default='false' description='fill the tile cache of the returned dataset from the source image, such that reading back does not download the uploaded data'/>";
         co_descr << "</CreationOptionList>";
         poDriver->SetMetadataItem(GDAL_DMD_CREATIONOPTIONLIST, co_descr.str().c_str());
         
         
         oo_descr << "    <Option name='timestamp' type='string' description='datetime as ISO8601 string to query a temporal slice of a spacetime array'/>";
-        oo_descr << "    <Option name='t' type='int' description='temporal array index to query a temporal slice of a spacetime array'/>";
+        oo_descr << "    <Option name='apply' type='string' description='derived band as name:AFL expression, may be repeated'/>";
+        oo_descr << "    <Option name='filter' type='string' description='AFL filter expression, cells not matching are returned as no data'/>";
+        oo_descr << "    <Option name='occupancy' type='boolean' description='detect empty blocks in advance and return them as no data without querying their data' default='YES'/>";
+        oo_descr << "    <Option name='align' type='boolean' description='pad the image such that each block is read from exactly one chunk' default='NO'/>";
+        oo_descr << "    <Option name='blocksize' type='int' description='block size in cells, rounded to a multiple or divisor of the chunk size'/>";
+        oo_descr << "    <Option name='request_mb' type='float' description='targeted block size in megabytes if no blocksize is given' default='4'/>";
+        oo_descr << "    <Option name='cache_mb' type='float' description='minimum size of the process-wide block cache in megabytes, which is only ever enlarged, see the SCIDB4GDAL_CACHE_MB configuration option'/>";
+        oo_descr << "    <Option name='cache_mode' type='string-select' description='SHARED keeps blocks in a process-wide cache shared with other datasets, GDAL only in the block cache of GDAL sized by GDAL_CACHEMAX'>";
+        oo_descr << "      <Value>SHARED</Value>";
+        oo_descr << "      <Value>GDAL</Value>";
+        oo_descr << "    </Option>";
+        oo_descr << "    <Option name='mask' type='boolean' description='report empty cells with a mask band shared by all bands' default='NO'/>";
+        oo_descr << "    <Option name='version' type='int' description='array version to be read, defaults to the most recent version at opening time'/>";
+        oo_descr << "    <Option name='reducer' type='string-select' description='composite the temporal interval of a spacetime array server-side'>"
+                    "       <Value>min</Value>"
+                    "       <Value>max</Value>"
+                    "       <Value>mean</Value>"
+                    "       <Value>median</Value>"
+                    "       <Value>latest</Value>"
+                    "    </Option>";
+        oo_descr << "    <Option name='t' type='string' description='temporal array index or datetime to query a temporal slice of a spacetime array, or an interval of those separated by / to query each slice of the interval as separate bands'/>";
         oo_descr <<  "</OpenOptionList>";
         poDriver->SetMetadataItem(GDAL_DMD_OPENOPTIONLIST, oo_descr.str().c_str());
         
@@ -100,6 +131,7 @@ void GDALRegister_SciDB() {
         poDriver->pfnDelete = scidb4gdal::SciDBDataset::Delete;
 
         poDriver->pfnCreateCopy = scidb4gdal::SciDBDataset::CreateCopy;
+        poDriver->pfnUnloadDriver = SciDBUnloadDriver;
         GetGDALDriverManager()->RegisterDriver(poDriver);
     }
 }
@@ -109,33 +141,113 @@ namespace scidb4gdal {
     *  SciDBRasterBand
     * =============================================
     */
-    SciDBRasterBand::SciDBRasterBand(SciDBDataset* poDS, SciDBSpatialArray* array,int nBand) 
+    /**
+    * Releases a materialized query result when leaving scope, unless the result has been handed over to a dataset
+    */
+    class MaterializedQueryGuard {
+    public:
+        MaterializedQueryGuard(ShimClient* client, const string& arrayname) : _client(client), _arrayname(arrayname) {}
+        ~MaterializedQueryGuard() {
+            if (!_arrayname.empty())
+                _client->releaseMaterializedQuery(_arrayname);
+        }
+        /** @brief Hands over the result to the caller, returns its array name */
+        string release() {
+            string name = _arrayname;
+            _arrayname.clear();
+            return name;
+        }
+
+    private:
+        ShimClient* _client;
+        string _arrayname;
+    };
+
+    /**
+    * Copies a window of w x h cells into a block buffer with a row length of nBlockXSize cells
+    */
+    static void copyWindowToBlock(const void* src, void* block, int w, int h, int nBlockXSize, size_t nbytes) {
+        for (int i = 0; i < h; ++i) {
+            memcpy(&((uint8_t*)block)[i * nBlockXSize * nbytes], &((const uint8_t*)src)[i * w * nbytes], w * nbytes);
+        }
+    }
+
+    SciDBRasterBand::SciDBRasterBand(SciDBDataset* poDS, SciDBSpatialArray* array, int nBand, int64_t tIndex) 
     {
         this->poDS = poDS;
         this->nBand = nBand;
         this->_array = array;
+        this->_nAttr = nBand;
+        this->_tIndex = tIndex;
 
         eDataType = Utils::scidbTypeIdToGDALType( _array->attrs[nBand].typeId); // Data type is mapped from SciDB's attribute data type
 
-        uint32_t nImgYSize(1 + _array->getYDim()->high - _array->getYDim()->low);
-        uint32_t nImgXSize(1 + _array->getXDim()->high - _array->getXDim()->low);
-        nBlockYSize = (_array->getYDim()->chunksize < nImgYSize)
-                        ? _array->getYDim()->chunksize
-                        : nImgYSize;
-        nBlockXSize = (_array->getXDim()->chunksize < nImgXSize)
-                        ? _array->getXDim()->chunksize
-                        : nImgXSize;
+        poDS->computeBlockSize(nBlockXSize, nBlockYSize);
     }
 
     SciDBRasterBand::~SciDBRasterBand() { FlushCache(); }
 
+    int SciDBRasterBand::GetMaskFlags() {
+        if (((SciDBDataset*)poDS)->_maskBand != NULL)
+            return GMF_PER_DATASET;
+        return GDALPamRasterBand::GetMaskFlags();
+    }
+
+    GDALRasterBand* SciDBRasterBand::GetMaskBand() {
+        if (((SciDBDataset*)poDS)->_maskBand != NULL)
+            return ((SciDBDataset*)poDS)->_maskBand;
+        return GDALPamRasterBand::GetMaskBand();
+    }
+
+    /* =============================================
+    *  SciDBMaskBand
+    * =============================================
+    */
+    SciDBMaskBand::SciDBMaskBand(SciDBDataset* poDS, int nBlockXSize, int nBlockYSize) {
+        this->poDS = poDS;
+        this->nBand = 0;
+        this->nRasterXSize = poDS->GetRasterXSize();
+        this->nRasterYSize = poDS->GetRasterYSize();
+        this->eDataType = GDT_Byte;
+        this->nBlockXSize = nBlockXSize;
+        this->nBlockYSize = nBlockYSize;
+    }
+
+    CPLErr SciDBMaskBand::IReadBlock(int nBlockXOff, int nBlockYOff, void* pImage) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        memset(pImage, 0, (size_t)nBlockXSize * nBlockYSize);
+        if (poGDS->isBlockEmpty(nBlockXOff, nBlockYOff, nBlockXSize, nBlockYSize))
+            return CE_None;
+
+        SciDBSpatialArray& array = poGDS->_array;
+        int64_t xmin = (int64_t)nBlockXOff * nBlockXSize + array.getXDim()->low;
+        int64_t xmax = std::min(xmin + nBlockXSize - 1, array.getXDim()->high);
+        int64_t ymin = (int64_t)nBlockYOff * nBlockYSize + array.getYDim()->low;
+        int64_t ymax = std::min(ymin + nBlockYSize - 1, array.getYDim()->high);
+
+        vector<uint8_t> bits;
+        if (poGDS->_client->getCellMask(array, xmin, ymin, xmax, ymax, bits) != SUCCESS)
+            return CE_Failure;
+
+        int w = 1 + xmax - xmin;
+        int h = 1 + ymax - ymin;
+        size_t rowBytes = (w + 7) / 8;
+        for (int r = 0; r < h; ++r) {
+            for (int c = 0; c < w; ++c) {
+                if ((bits[r * rowBytes + c / 8] >> (c % 8)) & 1)
+                    ((uint8_t*)pImage)[(size_t)r * nBlockXSize + c] = 255;
+            }
+        }
+        return CE_None;
+    }
+
     CPLErr SciDBRasterBand::GetStatistics(int bApproxOK, int bForce, double* pdfMin,
                                         double* pdfMax, double* pdfMean,
                                         double* pdfStdDev) {
         SciDBAttributeStats stats;
         ((SciDBDataset*)poDS)
             ->getClient()
-            ->getAttributeStats(*_array, this->nBand - 1, stats);
+            ->getAttributeStats(*_array, _nAttr, stats);
 
         *pdfMin = stats.min;
         *pdfMax = stats.max;
@@ -154,92 +266,343 @@ namespace scidb4gdal {
         // 	int32_t t_index = poGDS->_client->
         //
         // 	->_query->temp_index;
-        uint32_t tileId =
-            TileCache::getBlockId(nBlockXOff, nBlockYOff, nBand - 1, nBlockXSize,
-                                nBlockYSize, poGDS->GetRasterCount());
+        uint64_t tileId = TileCache::getBlockId(nBlockXOff, nBlockYOff, nBand - 1, poGDS->nBlocksPerRow(nBlockXSize),
+                                                poGDS->nBlocksPerColumn(nBlockYSize), poGDS->GetRasterCount());
+
+        // Empty blocks are filled with no data without querying SciDB
+        if (poGDS->isBlockEmpty(nBlockXOff, nBlockYOff, nBlockXSize, nBlockYSize)) {
+            double nodata = CPLAtof(poGDS->_client->getNoDataString(*_array, _nAttr).c_str());
+            GDALCopyWords(&nodata, GDT_Float64, 0, pImage, eDataType, GDALGetDataTypeSize(eDataType) / 8,
+                          nBlockXSize * nBlockYSize);
+            return CE_None;
+        }
 
         ArrayTile tile;
         tile.id = tileId;
-
-        // Check whether chunk is in cache
-        if (poGDS->_cache.has(tileId)) {
-            tile = *poGDS->_cache.get(tileId);
+        tile.version = _array->version;
+        tile.context = poGDS->_cacheContext;
+
+        tile.size = (size_t)nBlockXSize * nBlockYSize *
+                    Utils::scidbTypeIdBytes(_array->attrs[_nAttr].typeId); // Always allocate full block size
+
+        // Check whether chunk is in cache, GDAL only asks for blocks that are not in its own block cache
+        if (!poGDS->_useGDALCache && poGDS->_cache.read(tile.key(), pImage, tile.size))
+            return CE_None;
+
+        int64_t ymin = (int64_t)nBlockYOff * this->nBlockYSize + _array->getYDim()->low;
+        int64_t ymax = ymin + this->nBlockYSize - 1;
+        if (ymax > _array->getYDim()->high)
+            ymax = _array->getYDim()->high;
+
+        // without a private cache, data is written to GDAL's block directly
+        tile.data = poGDS->_useGDALCache ? pImage : poGDS->_cache.pool().acquire(tile.size); // owned by the cache after adding it
+
+        CPLErr res;
+        if (_tIndex >= 0) {
+            int64_t xmin = (int64_t)nBlockXOff * this->nBlockXSize + _array->getXDim()->low;
+            int64_t xmax = std::min(xmin + this->nBlockXSize - 1, _array->getXDim()->high);
+            // Temporal range datasets fetch several slices at once
+            res = fetchSlices(nBlockXOff, nBlockYOff, xmin, ymin, xmax, ymax, tile);
         } else {
-            int xmin = nBlockXOff * this->nBlockXSize + _array->getXDim()->low;
-            int xmax = xmin + this->nBlockXSize - 1;
-            if (xmax > _array->getXDim()->high)
-                xmax = _array->getXDim()->high;
-
-            int ymin = nBlockYOff * this->nBlockYSize + _array->getYDim()->low;
-            int ymax = ymin + this->nBlockYSize - 1;
-            if (ymax > _array->getYDim()->high)
-                ymax = _array->getYDim()->high;
-
-            // Read  and fetch data
-            bool use_subarray = true; // This is safer, between might lead to
-            // inconsistent results in some instances
-            // bool use_subarray = ! ( ( xmin % ( int ) _array->getXDim()->chunksize ==
-            // 0 ) && ( ymin % ( int ) _array->getYDim()->chunksize == 0 ) );
-
-            tile.size =
-                nBlockXSize * nBlockYSize *
-                Utils::scidbTypeIdBytes(
-                    _array->attrs[nBand - 1].typeId); // Always allocate full block size
-            tile.data = malloc(tile.size);            // will be freed automatically by cache
-
-            if ((nBlockXOff + 1) * this->nBlockXSize > poGDS->nRasterXSize) {
-                // This is a bit of a hack...
-//                 size_t dataSize = _array->attrs[nBand - 1].nullable ?  
-//                     (1 + xmax - xmin) * (1 + ymax - ymin) *   (Utils::scidbTypeIdBytes( _array->attrs[nBand - 1] .typeId + 1)) :
-//                     (1 + xmax - xmin) * (1 + ymax - ymin) *   Utils::scidbTypeIdBytes( _array->attrs[nBand - 1] .typeId); // This is smaller than the block size!
-                size_t dataSize = (1 + xmax - xmin) * (1 + ymax - ymin) *   Utils::scidbTypeIdBytes( _array->attrs[nBand - 1] .typeId); // This is smaller than the block size!
-   
-                void* buf = malloc(dataSize);
-
-                // Write to temporary buffer first
-                // TODO  t_index is set as zero for compiler testing... this must be
-                // changed
-                poGDS->getClient()->getData(*_array, nBand - 1, buf, xmin, ymin, xmax,
-                                            ymax, use_subarray); // GDAL bands start with
-                // 1, scidb attribute
-                // indexes with 0
-                for (int i = 0; i < (1 + ymax - ymin); ++i) {
-                    uint8_t* src = &((uint8_t*)buf)[i * (1 + xmax - xmin) *
-                                                    Utils::scidbTypeIdBytes(
-                                                        _array->attrs[nBand - 1].typeId)];
-                    uint8_t* dest =
-                        &((uint8_t*)tile.data)[i * this->nBlockXSize *
-                                            Utils::scidbTypeIdBytes(
-                                                _array->attrs[nBand - 1].typeId)];
-                    memcpy(dest, src,
-                        (1 + xmax - xmin) *
-                            Utils::scidbTypeIdBytes(_array->attrs[nBand - 1].typeId));
+            res = fetchBlockRow(nBlockXOff, nBlockYOff, ymin, ymax, tile);
+        }
+
+        if (!poGDS->_useGDALCache) {
+            if (res != CE_None) {
+                poGDS->_cache.pool().release(tile.data, tile.size);
+                return res;
+            }
+            // Copy from tile.data to pImage
+            memcpy(pImage, tile.data, tile.size);
+            poGDS->_cache.add(tile); // Add to cache
+        }
+        return res;
+    }
+
+    CPLErr SciDBRasterBand::IRasterIO(GDALRWFlag eRWFlag, int nXOff, int nYOff, int nXSize, int nYSize, void* pData,
+                                      int nBufXSize, int nBufYSize, GDALDataType eBufType, GSpacing nPixelSpace,
+                                      GSpacing nLineSpace, GDALRasterIOExtraArg* psExtraArg) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        string castType;
+        if (eBufType == GDT_Byte)
+            castType = "uint8";
+        else if (eBufType == GDT_Int16)
+            castType = "int16";
+        else if (eBufType == GDT_UInt16)
+            castType = "uint16";
+
+        size_t nbytes = GDALGetDataTypeSize(eBufType) / 8;
+        bool narrower = !castType.empty() && GDALGetDataTypeSize(eBufType) < GDALGetDataTypeSize(eDataType) &&
+                        !GDALDataTypeIsComplex(eDataType);
+        if (eRWFlag != GF_Read || !narrower || _tIndex >= 0 || nBufXSize != nXSize || nBufYSize != nYSize ||
+            (double)nXSize * nYSize * nbytes > (double)SCIDB4GDAL_MAINMEM_HARD_LIMIT_MB * 1024 * 1024) {
+            return GDALPamRasterBand::IRasterIO(eRWFlag, nXOff, nYOff, nXSize, nYSize, pData, nBufXSize, nBufYSize,
+                                                eBufType, nPixelSpace, nLineSpace, psExtraArg);
+        }
+
+        // windows that are served from caches or occupancy completely do not need the server
+        bool local = true;
+        for (int by = nYOff / nBlockYSize; local && by <= (nYOff + nYSize - 1) / nBlockYSize; ++by) {
+            for (int bx = nXOff / nBlockXSize; local && bx <= (nXOff + nXSize - 1) / nBlockXSize; ++bx) {
+                local = poGDS->isBlockEmpty(bx, by, nBlockXSize, nBlockYSize) || isBlockCached(bx, by, nBand - 1);
+            }
+        }
+        if (local) {
+            return GDALPamRasterBand::IRasterIO(eRWFlag, nXOff, nYOff, nXSize, nYSize, pData, nBufXSize, nBufYSize,
+                                                eBufType, nPixelSpace, nLineSpace, psExtraArg);
+        }
+
+        int64_t xmin = _array->getXDim()->low + nXOff;
+        int64_t ymin = _array->getYDim()->low + nYOff;
+        void* buf = malloc((size_t)nXSize * nYSize * nbytes);
+        if (poGDS->_client->getData(*_array, _nAttr, buf, xmin, ymin, xmin + nXSize - 1, ymin + nYSize - 1, true, true,
+                                    castType) != SUCCESS) {
+            free(buf);
+            return CE_Failure;
+        }
+        for (int i = 0; i < nYSize; ++i) {
+            GDALCopyWords(&((uint8_t*)buf)[(size_t)i * nXSize * nbytes], eBufType, nbytes,
+                          &((uint8_t*)pData)[i * nLineSpace], eBufType, (int)nPixelSpace, nXSize);
+        }
+        free(buf);
+        return CE_None;
+    }
+
+    bool SciDBRasterBand::isBlockCached(int nBlockXOff, int nBlockYOff, int iBand) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        if (!poGDS->_useGDALCache) {
+            return poGDS->_cache.has(TileKey(TileCache::getBlockId(nBlockXOff, nBlockYOff, iBand, poGDS->nBlocksPerRow(nBlockXSize),
+                                                                   poGDS->nBlocksPerColumn(nBlockYSize), poGDS->GetRasterCount()),
+                                             _array->version, poGDS->_cacheContext));
+        }
+        GDALRasterBlock* block = poGDS->GetRasterBand(iBand + 1)->TryGetLockedBlockRef(nBlockXOff, nBlockYOff);
+        if (block == NULL)
+            return false;
+        block->DropLock();
+        return true;
+    }
+
+    void SciDBRasterBand::cacheBlock(int nBlockXOff, int nBlockYOff, int iBand, void* data, size_t size) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        if (!poGDS->_useGDALCache) {
+            ArrayTile tile;
+            tile.id = TileCache::getBlockId(nBlockXOff, nBlockYOff, iBand, poGDS->nBlocksPerRow(nBlockXSize),
+                                            poGDS->nBlocksPerColumn(nBlockYSize), poGDS->GetRasterCount());
+            tile.version = _array->version;
+            tile.context = poGDS->_cacheContext;
+            tile.data = data;
+            tile.size = size;
+            poGDS->_cache.add(tile);
+            return;
+        }
+        // blocks of GDAL's cache are created without reading them, hence IReadBlock is not called recursively
+        GDALRasterBlock* block = poGDS->GetRasterBand(iBand + 1)->GetLockedBlockRef(nBlockXOff, nBlockYOff, TRUE);
+        if (block != NULL) {
+            memcpy(block->GetDataRef(), data, size);
+            block->DropLock();
+        }
+        poGDS->_cache.pool().release(data, size);
+    }
+
+    CPLErr SciDBRasterBand::fetchBlockRow(int nBlockXOff, int nBlockYOff, int64_t ymin, int64_t ymax, ArrayTile& tile) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        size_t nbytes = Utils::scidbTypeIdBytes(_array->attrs[_nAttr].typeId);
+        int nBlocksX = poGDS->nBlocksPerRow(nBlockXSize);
+
+        // Scanline oriented readers continue with the right neighbours, extend the request until the first block that
+        // is cached already or known to be empty
+        // Attributes of joined arrays are read together, the other bands' blocks go to the cache as well
+        bool joined = !_array->joins.empty() && _tIndex < 0 && (int)_array->attrs.size() == poGDS->GetRasterCount() &&
+                      (poGDS->_client->_qp == NULL || poGDS->_client->_qp->reducer.empty());
+        size_t maxBlocks = std::min((size_t)SCIDB4GDAL_COALESCE_MAX_BLOCKS,
+                                    (poGDS->cacheBudget() / 2) / (tile.size * (joined ? _array->attrs.size() : 1)));
+        int nBlocks = 1;
+        while ((size_t)nBlocks < maxBlocks && nBlockXOff + nBlocks < nBlocksX) {
+            if (isBlockCached(nBlockXOff + nBlocks, nBlockYOff, nBand - 1) ||
+                poGDS->isBlockEmpty(nBlockXOff + nBlocks, nBlockYOff, nBlockXSize, nBlockYSize))
+                break;
+            ++nBlocks;
+        }
+
+        int64_t xmin = (int64_t)nBlockXOff * nBlockXSize + _array->getXDim()->low;
+        int64_t xmax = std::min(xmin + (int64_t)nBlocks * nBlockXSize - 1, _array->getXDim()->high);
+        int w = 1 + xmax - xmin;
+        int h = 1 + ymax - ymin;
+
+        if (joined)
+            return fetchJoinedBlockRow(nBlockXOff, nBlockYOff, nBlocks, xmin, ymin, xmax, ymax, tile);
+
+        // A single complete block is written to the tile directly
+        if (nBlocks == 1 && w == nBlockXSize)
+            return (poGDS->_client->getData(*_array, _nAttr, tile.data, xmin, ymin, xmax, ymax) == SUCCESS) ? CE_None
+                                                                                                            : CE_Failure;
+
+        BufferPool& pool = poGDS->_cache.pool();
+        size_t bufSize = (size_t)w * h * nbytes;
+        void* buf = pool.acquire(bufSize);
+        if (poGDS->_client->getData(*_array, _nAttr, buf, xmin, ymin, xmax, ymax) != SUCCESS) {
+            pool.release(buf, bufSize);
+            return CE_Failure;
+        }
+
+        // Split the rectangle into blocks, all but the requested one go to the cache
+        for (int i = 0; i < nBlocks; ++i) {
+            void* block = (i == 0) ? tile.data : pool.acquire(tile.size);
+            int bw = std::min(nBlockXSize, w - i * nBlockXSize);
+            for (int r = 0; r < h; ++r) {
+                memcpy(&((uint8_t*)block)[(size_t)r * nBlockXSize * nbytes],
+                       &((uint8_t*)buf)[((size_t)r * w + (size_t)i * nBlockXSize) * nbytes], bw * nbytes);
+            }
+            if (i > 0)
+                cacheBlock(nBlockXOff + i, nBlockYOff, nBand - 1, block, tile.size);
+        }
+        pool.release(buf, bufSize);
+        return CE_None;
+    }
+
+    CPLErr SciDBRasterBand::fetchJoinedBlockRow(int nBlockXOff, int nBlockYOff, int nBlocks, int64_t xmin, int64_t ymin,
+                                                int64_t xmax, int64_t ymax, ArrayTile& tile) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        int w = 1 + xmax - xmin;
+        int h = 1 + ymax - ymin;
+
+        vector<uint8_t> nbands;
+        vector<size_t> offsets; // of attributes within a cell
+        size_t cellSize = 0;
+        for (uint32_t i = 0; i < _array->attrs.size(); ++i) {
+            nbands.push_back((uint8_t)i);
+            offsets.push_back(cellSize);
+            cellSize += Utils::scidbTypeIdBytes(_array->attrs[i].typeId);
+        }
+
+        BufferPool& pool = poGDS->_cache.pool();
+        size_t bufSize = (size_t)w * h * cellSize;
+        void* buf = pool.acquire(bufSize);
+        if (poGDS->_client->getAttributesData(*_array, nbands, buf, xmin, ymin, xmax, ymax) != SUCCESS) {
+            pool.release(buf, bufSize);
+            return CE_Failure;
+        }
+
+        for (size_t a = 0; a < nbands.size(); ++a) {
+            size_t nbytes = Utils::scidbTypeIdBytes(_array->attrs[a].typeId);
+            size_t size = (size_t)nBlockXSize * nBlockYSize * nbytes;
+            for (int i = 0; i < nBlocks; ++i) {
+                bool requested = ((int)a == _nAttr && i == 0);
+                if (!requested && isBlockCached(nBlockXOff + i, nBlockYOff, (int)a))
+                    continue;
+                void* block = requested ? tile.data : pool.acquire(size);
+                int bw = std::min(nBlockXSize, w - i * nBlockXSize);
+                for (int r = 0; r < h; ++r) {
+                    for (int c = 0; c < bw; ++c) {
+                        memcpy(&((uint8_t*)block)[((size_t)r * nBlockXSize + c) * nbytes],
+                               &((uint8_t*)buf)[((size_t)r * w + (size_t)i * nBlockXSize + c) * cellSize + offsets[a]],
+                               nbytes);
+                    }
                 }
-                free(buf);
-            } else {
-                // This is the most efficient!
-                poGDS->getClient()->getData(*_array, nBand - 1, tile.data, xmin, ymin,
-                                            xmax, ymax,
-                                            use_subarray); // GDAL bands start
-                                                        // with 1, scidb
-                                                        // attribute
-                                                        // indexes with 0
+                if (!requested)
+                    cacheBlock(nBlockXOff + i, nBlockYOff, (int)a, block, size);
             }
         }
+        pool.release(buf, bufSize);
+        return CE_None;
+    }
 
-        poGDS->_cache.add(tile); // Add to cache
+    CPLErr SciDBRasterBand::fetchSlices(int nBlockXOff, int nBlockYOff, int64_t xmin, int64_t ymin, int64_t xmax,
+                                        int64_t ymax, ArrayTile& tile) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        SciDBSpatioTemporalArray* starray = dynamic_cast<SciDBSpatioTemporalArray*>(_array);
+        QueryParameters* qp = poGDS->_client->_qp;
+        if (!starray || !qp || !qp->hasTemporalRange)
+            return CE_Failure;
+
+        size_t nbytes = Utils::scidbTypeIdBytes(_array->attrs[_nAttr].typeId);
+        int w = 1 + xmax - xmin;
+        int h = 1 + ymax - ymin;
+        size_t sliceSize = (size_t)w * h * nbytes;
+
+        // Slices sharing the temporal chunk of the requested slice come at (almost) no extra cost
+        SciDBDimension* tdim = starray->getTDim();
+        int64_t cs = (tdim->chunksize > 0) ? tdim->chunksize : 1;
+        int64_t chunkStart = tdim->start + ((_tIndex - tdim->start) / cs) * cs;
+        int64_t tmin = std::max(chunkStart, qp->lower_bound);
+        int64_t tmax = std::min(chunkStart + cs - 1, qp->upper_bound);
+
+        // but do not fetch more slices than half of the cache can hold
+        int64_t maxSlices = (int64_t)std::max((size_t)1, (poGDS->cacheBudget() / 2) / sliceSize);
+        if (1 + tmax - tmin > maxSlices) {
+            tmin = _tIndex;
+            tmax = std::min(tmax, _tIndex + maxSlices - 1);
+        }
 
-        
-        // Copy from tile.data to pImage
-        memcpy(pImage, tile.data, tile.size);
+        BufferPool& pool = poGDS->_cache.pool();
+        size_t bufSize = (1 + tmax - tmin) * sliceSize;
+        void* buf = pool.acquire(bufSize);
+        if (poGDS->_client->getTimeSeries(*starray, _nAttr, buf, xmin, ymin, xmax, ymax, tmin, tmax) != SUCCESS) {
+            pool.release(buf, bufSize);
+            return CE_Failure;
+        }
 
+        for (int64_t t = tmin; t <= tmax; ++t) {
+            void* src = &((uint8_t*)buf)[(t - tmin) * sliceSize];
+            if (t == _tIndex) {
+                copyWindowToBlock(src, tile.data, w, h, nBlockXSize, nbytes);
+                continue;
+            }
+            // bands are ordered by temporal index first, attributes second, empty slices have no bands
+            vector<int64_t>::const_iterator s = std::lower_bound(poGDS->_slices.begin(), poGDS->_slices.end(), t);
+            if (s == poGDS->_slices.end() || *s != t)
+                continue;
+            int band = (s - poGDS->_slices.begin()) * _array->attrs.size() + _nAttr;
+            if (isBlockCached(nBlockXOff, nBlockYOff, band))
+                continue;
+            void* block = pool.acquire(tile.size);
+            copyWindowToBlock(src, block, w, h, nBlockXSize, nbytes);
+            cacheBlock(nBlockXOff, nBlockYOff, band, block, tile.size);
+        }
+        pool.release(buf, bufSize);
         return CE_None;
     }
 
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(2, 2, 0)
+    int SciDBRasterBand::IGetDataCoverageStatus(int nXOff, int nYOff, int nXSize, int nYSize, int nMaskFlagStop,
+                                                double* pdfDataPct) {
+        SciDBDataset* poGDS = (SciDBDataset*)poDS;
+        if (!poGDS->_useOccupancy) {
+            if (pdfDataPct != NULL)
+                *pdfDataPct = 100.0;
+            return GDAL_DATA_COVERAGE_STATUS_UNIMPLEMENTED | GDAL_DATA_COVERAGE_STATUS_DATA;
+        }
+
+        int status = 0;
+        double covered = 0;
+        for (int by = nYOff / nBlockYSize; by <= (nYOff + nYSize - 1) / nBlockYSize; ++by) {
+            for (int bx = nXOff / nBlockXSize; bx <= (nXOff + nXSize - 1) / nBlockXSize; ++bx) {
+                if (poGDS->isBlockEmpty(bx, by, nBlockXSize, nBlockYSize)) {
+                    status |= GDAL_DATA_COVERAGE_STATUS_EMPTY;
+                } else {
+                    status |= GDAL_DATA_COVERAGE_STATUS_DATA;
+                    // area of the window within this block
+                    int w = std::min(nXOff + nXSize, (bx + 1) * nBlockXSize) - std::max(nXOff, bx * nBlockXSize);
+                    int h = std::min(nYOff + nYSize, (by + 1) * nBlockYSize) - std::max(nYOff, by * nBlockYSize);
+                    covered += (double)w * h;
+                }
+                if (nMaskFlagStop != 0 && (status & nMaskFlagStop) != 0) {
+                    if (pdfDataPct != NULL)
+                        *pdfDataPct = -1.0;
+                    return status;
+                }
+            }
+        }
+        if (pdfDataPct != NULL)
+            *pdfDataPct = 100.0 * covered / ((double)nXSize * nYSize);
+        return status;
+    }
+#endif
+
     double SciDBRasterBand::GetNoDataValue(int* pbSuccess) {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_NODATA;
         double result;
-        MD md = _array->attrs[nBand - 1].md[""];
+        MD md = _array->attrs[_nAttr].md[""];
         if (md.find(key) == md.end()) {
             if (pbSuccess != NULL)
                 *pbSuccess = false;
@@ -263,7 +626,7 @@ namespace scidb4gdal {
 
     double SciDBRasterBand::GetMaximum(int* pbSuccess) {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_MAX;
-        MD md = _array->attrs[nBand - 1].md[""]; // TODO: Add domain
+        MD md = _array->attrs[_nAttr].md[""]; // TODO: Add domain
         if (md.find(key) == md.end()) {
             if (pbSuccess != NULL)
                 *pbSuccess = false;
@@ -276,7 +639,7 @@ namespace scidb4gdal {
 
     double SciDBRasterBand::GetMinimum(int* pbSuccess) {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_MIN;
-        MD md = _array->attrs[nBand - 1].md[""]; // TODO: Add domain
+        MD md = _array->attrs[_nAttr].md[""]; // TODO: Add domain
         if (md.find(key) == md.end()) {
             if (pbSuccess != NULL)
                 *pbSuccess = false;
@@ -289,7 +652,7 @@ namespace scidb4gdal {
 
     double SciDBRasterBand::GetOffset(int* pbSuccess) {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_OFFSET;
-        MD md = _array->attrs[nBand - 1].md[""]; // TODO: Add domain
+        MD md = _array->attrs[_nAttr].md[""]; // TODO: Add domain
         if (md.find(key) == md.end()) {
             if (pbSuccess != NULL)
                 *pbSuccess = false;
@@ -302,7 +665,7 @@ namespace scidb4gdal {
 
     double SciDBRasterBand::GetScale(int* pbSuccess) {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_SCALE;
-        MD md = _array->attrs[nBand - 1].md[""]; // TODO: Add domain
+        MD md = _array->attrs[_nAttr].md[""]; // TODO: Add domain
         if (md.find(key) == md.end()) {
             if (pbSuccess != NULL)
                 *pbSuccess = false;
@@ -315,19 +678,264 @@ namespace scidb4gdal {
 
     const char* SciDBRasterBand::GetUnitType() {
         string key = SCIDB4GDAL_DEFAULTMDFIELD_UNIT;
-        MD md = _array->attrs[nBand - 1].md[""]; // TODO: Add domain
+        MD md = _array->attrs[_nAttr].md[""]; // TODO: Add domain
         if (md.find(key) == md.end()) {
             return "";
         }
         return md[key].c_str();
     }
 
+    CPLErr SciDBRasterBand::fetchPointValues(const vector<int64_t>& cells, vector<double>& values) {
+        // query each distinct cell only once
+        map<pair<int64_t, int64_t>, size_t> index;
+        vector<int64_t> unique;
+        vector<size_t> pos(cells.size() / 2);
+        for (size_t i = 0; i < cells.size() / 2; ++i) {
+            pair<int64_t, int64_t> c(cells[2 * i], cells[2 * i + 1]);
+            map<pair<int64_t, int64_t>, size_t>::iterator it = index.find(c);
+            if (it == index.end()) {
+                it = index.insert(make_pair(c, unique.size() / 2)).first;
+                unique.push_back(c.first);
+                unique.push_back(c.second);
+            }
+            pos[i] = it->second;
+        }
+
+        size_t nbytes = Utils::scidbTypeIdBytes(_array->attrs[_nAttr].typeId);
+        void* buf = malloc(nbytes * (unique.size() / 2 + 1));
+        if (((SciDBDataset*)poDS)->getClient()->getPointValues(*_array, _nAttr, unique, buf) != SUCCESS) {
+            free(buf);
+            return CE_Failure;
+        }
+        vector<double> uvalues(unique.size() / 2 + 1);
+        GDALCopyWords(buf, eDataType, nbytes, &uvalues[0], GDT_Float64, sizeof(double), unique.size() / 2);
+        free(buf);
+
+        values.resize(pos.size());
+        for (size_t i = 0; i < pos.size(); ++i)
+            values[i] = uvalues[pos[i]];
+        return CE_None;
+    }
+
+    CPLErr SciDBRasterBand::fetchZonalStatistics(const string& zoneFile, string& out) {
+        GDALDataset* zoneDS = (GDALDataset*)GDALOpen(zoneFile.c_str(), GA_ReadOnly);
+        if (zoneDS == NULL) {
+            Utils::warn("Cannot open zone raster '" + zoneFile + "'");
+            return CE_Failure;
+        }
+
+        // zones must share the pixel grid of the array, their extent may differ
+        double zt[6], at[6];
+        if (zoneDS->GetGeoTransform(zt) != CE_None || poDS->GetGeoTransform(at) != CE_None) {
+            Utils::warn("Zone raster and array must both be georeferenced");
+            GDALClose(zoneDS);
+            return CE_Failure;
+        }
+        double xoff = (zt[0] - at[0]) / at[1];
+        double yoff = (zt[3] - at[3]) / at[5];
+        double eps = 1e-6;
+        if (fabs(zt[1] - at[1]) > eps * fabs(at[1]) || fabs(zt[5] - at[5]) > eps * fabs(at[5]) || zt[2] != at[2] ||
+            zt[4] != at[4] || fabs(xoff - floor(xoff + 0.5)) > 1e-3 || fabs(yoff - floor(yoff + 0.5)) > 1e-3) {
+            Utils::warn("Zone raster is not aligned to the pixel grid of the array");
+            GDALClose(zoneDS);
+            return CE_Failure;
+        }
+        int zx = (int)floor(xoff + 0.5);
+        int zy = (int)floor(yoff + 0.5);
+
+        // intersection of both rasters in image coordinates of the array
+        int x0 = std::max(0, zx), y0 = std::max(0, zy);
+        int x1 = std::min(nRasterXSize, zx + zoneDS->GetRasterXSize()) - 1;
+        int y1 = std::min(nRasterYSize, zy + zoneDS->GetRasterYSize()) - 1;
+        out = "zone,count,sum,mean,stdev,min,max\n";
+        if (x1 < x0 || y1 < y0) {
+            GDALClose(zoneDS);
+            return CE_None;
+        }
+
+        size_t n = (size_t)(1 + x1 - x0) * (1 + y1 - y0);
+        if (n * sizeof(int32_t) > ((size_t)SCIDB4GDAL_MAINMEM_HARD_LIMIT_MB) * 1024 * 1024) {
+            Utils::error("Zone raster exceeds the main memory limit");
+            GDALClose(zoneDS);
+            return CE_Failure;
+        }
+
+        GDALRasterBand* zoneBand = zoneDS->GetRasterBand(1);
+        int hasNoData = 0;
+        double noData = zoneBand->GetNoDataValue(&hasNoData);
+        int32_t zoneNoData = (hasNoData && noData >= INT_MIN && noData <= INT_MAX) ? (int32_t)noData : INT_MIN;
+
+        int32_t* zones = (int32_t*)malloc(n * sizeof(int32_t));
+        if (zoneBand->RasterIO(GF_Read, x0 - zx, y0 - zy, 1 + x1 - x0, 1 + y1 - y0, zones, 1 + x1 - x0, 1 + y1 - y0,
+                               GDT_Int32, 0, 0, NULL) != CE_None) {
+            free(zones);
+            GDALClose(zoneDS);
+            return CE_Failure;
+        }
+        GDALClose(zoneDS);
+
+        string table;
+        int64_t xlow = _array->getXDim()->low;
+        int64_t ylow = _array->getYDim()->low;
+        StatusCode res = ((SciDBDataset*)poDS)->getClient()->getZonalStatistics(
+            *_array, _nAttr, zones, zoneNoData, xlow + x0, ylow + y0, xlow + x1, ylow + y1, table);
+        free(zones);
+        if (res != SUCCESS)
+            return CE_Failure;
+        out += table;
+        return CE_None;
+    }
+
+    const char* SciDBRasterBand::GetMetadataItem(const char* pszName, const char* pszDomain) {
+        if (pszDomain != NULL && pszName != NULL && EQUAL(pszDomain, "LocationInfo")) {
+            int x, y;
+            if (sscanf(pszName, "Pixel_%d_%d", &x, &y) != 2 || x < 0 || y < 0 || x >= nRasterXSize || y >= nRasterYSize)
+                return NULL;
+            vector<int64_t> cells;
+            cells.push_back(x + _array->getXDim()->low);
+            cells.push_back(y + _array->getYDim()->low);
+            vector<double> values;
+            if (fetchPointValues(cells, values) != CE_None)
+                return NULL;
+            stringstream out;
+            out << std::setprecision(numeric_limits<double>::digits10);
+            out << "<LocationInfo><Value>" << values[0] << "</Value></LocationInfo>";
+            _drillResult = out.str();
+            return _drillResult.c_str();
+        }
+
+        if (pszDomain != NULL && pszName != NULL && EQUAL(pszDomain, SCIDB4GDAL_MDDOMAIN_POINTS)) {
+            vector<string> parts;
+            string list = pszName;
+            boost::algorithm::trim(list);
+            boost::split(parts, list, boost::is_any_of(" ;\n"), boost::token_compress_on);
+
+            // world coordinates to array coordinates, cells are identified by their upper left corner
+            vector<double> wx, wy;
+            vector<int64_t> cells;
+            for (size_t i = 0; i < parts.size(); ++i) {
+                double px, py;
+                if (sscanf(parts[i].c_str(), "%lf,%lf", &px, &py) != 2) {
+                    Utils::warn("Invalid point '" + parts[i] + "', please use x,y");
+                    return NULL;
+                }
+                AffineTransform::double2 p(px, py);
+                _array->affineTransform.fInv(p);
+                wx.push_back(px);
+                wy.push_back(py);
+                cells.push_back((int64_t)floor(p.x));
+                cells.push_back((int64_t)floor(p.y));
+            }
+
+            vector<double> values;
+            if (fetchPointValues(cells, values) != CE_None)
+                return NULL;
+
+            stringstream out;
+            out << std::setprecision(numeric_limits<double>::digits10);
+            for (size_t i = 0; i < values.size(); ++i) {
+                out << wx[i] << "," << wy[i] << "," << values[i] << "\n";
+            }
+            _drillResult = out.str();
+            return _drillResult.c_str();
+        }
+
+        if (pszDomain != NULL && pszName != NULL && EQUAL(pszDomain, SCIDB4GDAL_MDDOMAIN_ZONES)) {
+            if (fetchZonalStatistics(pszName, _drillResult) != CE_None)
+                return NULL;
+            return _drillResult.c_str();
+        }
+
+        if (pszDomain == NULL || !EQUAL(pszDomain, SCIDB4GDAL_MDDOMAIN_DRILL) || pszName == NULL)
+            return GDALPamRasterBand::GetMetadataItem(pszName, pszDomain);
+
+        SciDBSpatioTemporalArray* starray = dynamic_cast<SciDBSpatioTemporalArray*>(_array);
+        if (!starray) {
+            Utils::warn("Time series can only be requested from spacetime arrays");
+            return NULL;
+        }
+
+        int x, y, w = 1, h = 1;
+        if (sscanf(pszName, "Pixel_%d_%d", &x, &y) != 2 &&
+            sscanf(pszName, "Window_%d_%d_%d_%d", &x, &y, &w, &h) != 4) {
+            Utils::warn("Invalid time series request '" + string(pszName) + "', please use Pixel_x_y or Window_x_y_w_h");
+            return NULL;
+        }
+        if (x < 0 || y < 0 || w < 1 || h < 1 || x + w > nRasterXSize || y + h > nRasterYSize) {
+            Utils::warn("Requested time series window is outside the image");
+            return NULL;
+        }
+
+        int64_t tmin = starray->getTDim()->low;
+        int64_t tmax = starray->getTDim()->high;
+
+        // restrict the query to populated temporal indexes, empty ones are omitted in the result
+        const vector<int64_t>* populated = ((SciDBDataset*)poDS)->populatedTIndexes();
+        if (populated != NULL) {
+            if (populated->empty()) {
+                _drillResult = "";
+                return _drillResult.c_str();
+            }
+            tmin = std::max(tmin, populated->front());
+            tmax = std::min(tmax, populated->back());
+        }
+
+        size_t nt = 1 + tmax - tmin;
+        size_t ncells = (size_t)w * h;
+        size_t nbytes = Utils::scidbTypeIdBytes(_array->attrs[_nAttr].typeId);
+        if (nt * ncells * nbytes > ((size_t)SCIDB4GDAL_MAINMEM_HARD_LIMIT_MB) * 1024 * 1024) {
+            Utils::error("Requested time series exceeds the main memory limit, please use a smaller window");
+            return NULL;
+        }
+
+        void* buf = malloc(nt * ncells * nbytes);
+        int64_t xmin = x + _array->getXDim()->low;
+        int64_t ymin = y + _array->getYDim()->low;
+        if (((SciDBDataset*)poDS)->getClient()->getTimeSeries(*starray, _nAttr, buf, xmin, ymin, xmin + w - 1,
+                                                              ymin + h - 1, tmin, tmax) != SUCCESS) {
+            free(buf);
+            return NULL;
+        }
+
+        // one line per temporal index: timestamp followed by cell values
+        double* values = (double*)malloc(ncells * sizeof(double));
+        stringstream out;
+        out << std::setprecision(numeric_limits<double>::digits10);
+        for (size_t it = 0; it < nt; ++it) {
+            if (populated != NULL && !std::binary_search(populated->begin(), populated->end(), tmin + (int64_t)it))
+                continue;
+            GDALCopyWords(&((uint8_t*)buf)[it * ncells * nbytes], eDataType, nbytes, values, GDT_Float64,
+                          sizeof(double), ncells);
+            TPoint time = starray->datetimeAtIndex(tmin + it);
+            time._resolution = starray->getTInterval()->_resolution;
+            out << time.toStringISO();
+            for (size_t i = 0; i < ncells; ++i) {
+                out << "," << values[i];
+            }
+            out << "\n";
+        }
+        free(values);
+        free(buf);
+
+        _drillResult = out.str();
+        return _drillResult.c_str();
+    }
+
     /* =============================================
     *  SciDBDataset
     * =============================================
     */
     SciDBDataset::SciDBDataset(SciDBSpatialArray& array, ShimClient* client)
-        : _array(array), _client(client) {
+        : _array(array), _client(client), _cache(SharedTileCache::instance()), _cacheContext(0), _useOccupancy(client->_qp != NULL && client->_qp->useOccupancy), _nBlocksX(0),
+          _nBlocksY(0), _maskBand(NULL), _tIndexesLoaded(false), _tIndexesValid(false) {
+        // the cache is shared, a dataset may enlarge it but must not evict blocks of others by shrinking it
+        if (client->_qp != NULL && client->_qp->cacheMB > 0)
+            _cache.growMaxSize((size_t)(client->_qp->cacheMB * 1024 * 1024));
+        string mode = (client->_qp != NULL) ? client->_qp->cacheMode : "";
+        if (mode.empty())
+            mode = CPLGetConfigOption("SCIDB4GDAL_CACHE_MODE", "SHARED");
+        _useGDALCache = EQUAL(mode.c_str(), "GDAL");
+
         // TODO check if the +1 is really needed or if this leeds to the one pixel
         // borders
         this->nRasterXSize = 1 + _array.getXDim()->high - _array.getXDim()->low;
@@ -345,22 +953,67 @@ namespace scidb4gdal {
         for (itr = kv.begin(); itr != kv.end(); ++itr) {
             this->SetMetadataItem((*itr).first.c_str(), (*itr).second.c_str());
         }
-
-        // Create GDAL Bands
-        for (uint32_t i = 0; i < _array.attrs.size(); ++i)
-            this->SetBand(i + 1, new SciDBRasterBand(this, &_array, i));
+        if (_array.version > 0) {
+            this->SetMetadataItem("VERSION", boost::lexical_cast<string>(_array.version).c_str());
+        }
 
         this->SetDescription(_array.toString().c_str());
 
         SciDBSpatialArray* arr_ptr = &this->_array;
         SciDBSpatioTemporalArray* st_arr_ptr = dynamic_cast<SciDBSpatioTemporalArray*>(arr_ptr);
 
+        // Create GDAL Bands, for temporal ranges one band per temporal index and attribute
+        if (st_arr_ptr && _client->_qp->hasTemporalRange && _client->_qp->reducer.empty()) {
+            // temporal indexes without any data are not exposed as bands
+            const vector<int64_t>* populated = populatedTIndexes();
+            for (int64_t t = _client->_qp->lower_bound; t <= _client->_qp->upper_bound; ++t) {
+                if (populated == NULL || std::binary_search(populated->begin(), populated->end(), t))
+                    _slices.push_back(t);
+            }
+            if (_slices.empty()) {
+                Utils::warn("Specified temporal interval contains no data");
+                for (int64_t t = _client->_qp->lower_bound; t <= _client->_qp->upper_bound; ++t)
+                    _slices.push_back(t);
+            }
+
+            int nb = 0;
+            for (size_t s = 0; s < _slices.size(); ++s) {
+                int64_t t = _slices[s];
+                TPoint time = st_arr_ptr->datetimeAtIndex(t);
+                time._resolution = st_arr_ptr->getTInterval()->_resolution;
+                for (uint32_t i = 0; i < _array.attrs.size(); ++i) {
+                    SciDBRasterBand* band = new SciDBRasterBand(this, &_array, i, t);
+                    this->SetBand(++nb, band);
+                    band->SetDescription((_array.attrs[i].name + " " + time.toStringISO()).c_str());
+                    band->SetMetadataItem("TIMESTAMP", time.toStringISO().c_str());
+                }
+            }
+        } else {
+            for (uint32_t i = 0; i < _array.attrs.size(); ++i)
+                this->SetBand(i + 1, new SciDBRasterBand(this, &_array, i));
+
+            // slices of temporal ranges differ in their empty cells, hence the mask is only offered for single images
+            if (_client->_qp != NULL && _client->_qp->useMask && nBands > 0) {
+                int nBlockXSize, nBlockYSize;
+                GetRasterBand(1)->GetBlockSize(&nBlockXSize, &nBlockYSize);
+                _maskBand = new SciDBMaskBand(this, nBlockXSize, nBlockYSize);
+            }
+        }
+        initCacheContext();
+
         // check if dynamic cast was successfull. if so then check for the temporal
         // index and then calculate the timestamp according to the resolution
         if (st_arr_ptr) {
-            int tmin = st_arr_ptr->getTDim()->low;
-            int tmax = st_arr_ptr->getTDim()->high;
-            int tindex = -1;
+            int64_t tmin = st_arr_ptr->getTDim()->low;
+            int64_t tmax = st_arr_ptr->getTDim()->high;
+            int64_t tindex = -1;
+            if (_client->_qp->hasTemporalRange) {
+                tmin = _client->_qp->lower_bound;
+                tmax = _client->_qp->upper_bound;
+            }
+            if (!_client->_qp->reducer.empty()) {
+                this->SetMetadataItem("COMPOSITE", _client->_qp->reducer.c_str());
+            }
             if (_client->_qp->hasTemporalIndex) {
                 tindex = _client->_qp->temp_index; // TODO find the place where the
                 // temporal index is stored in the
@@ -421,8 +1074,148 @@ namespace scidb4gdal {
         return out->List();
     }
 
+    void SciDBDataset::computeBlockSize(int& nBlockXSize, int& nBlockYSize) const {
+        const SciDBDimension* dims[2] = {_array.getXDim(), _array.getYDim()};
+        int64_t img[2] = {nRasterXSize, nRasterYSize};
+        int64_t bs[2];
+        for (int i = 0; i < 2; ++i)
+            bs[i] = (dims[i]->chunksize > 0) ? (int64_t)dims[i]->chunksize : SCIDB4GDAL_DEFAULT_BLOCKSIZE;
+
+        QueryParameters* qp = _client->_qp;
+        if (qp != NULL && qp->blockSize > 0) {
+            // nearest multiple of the chunk size, or the largest divisor not exceeding the requested size
+            for (int i = 0; i < 2; ++i) {
+                if (qp->blockSize >= bs[i]) {
+                    bs[i] = ((qp->blockSize + bs[i] / 2) / bs[i]) * bs[i];
+                } else {
+                    int64_t d = qp->blockSize;
+                    while (bs[i] % d != 0)
+                        --d;
+                    bs[i] = d;
+                }
+            }
+        } else {
+            size_t nbytes = 1;
+            for (size_t i = 0; i < _array.attrs.size(); ++i)
+                nbytes = std::max(nbytes, Utils::scidbTypeIdBytes(_array.attrs[i].typeId));
+            double target = (qp != NULL && qp->requestMB > 0) ? qp->requestMB : SCIDB4GDAL_DEFAULT_REQUEST_MB;
+            target = std::min(target * 1024 * 1024, (_useGDALCache ? cacheBudget() / 4 : _cache.maxTileSize() / 2) * 1.0);
+
+            // Small chunks are combined by doubling the block size as long as the image is larger than a block
+            bool grown = true;
+            while (grown) {
+                grown = false;
+                for (int i = 0; i < 2; ++i) {
+                    if (bs[i] < img[i] && 2.0 * bs[0] * bs[1] * nbytes <= target) {
+                        bs[i] *= 2;
+                        grown = true;
+                    }
+                }
+            }
+            // Large chunks are split by halving the longer side while the result still divides the chunk size
+            while ((double)bs[0] * bs[1] * nbytes > target) {
+                int i = (bs[0] >= bs[1]) ? 0 : 1;
+                if (bs[i] % 2 != 0)
+                    i = 1 - i;
+                if (bs[i] % 2 != 0)
+                    break;
+                bs[i] /= 2;
+            }
+        }
+        nBlockXSize = (int)std::min(bs[0], img[0]);
+        nBlockYSize = (int)std::min(bs[1], img[1]);
+    }
+
+    void SciDBDataset::initCacheContext() {
+        if (_array.version <= 0) {
+            _cacheContext = _cache.uniqueContext();
+            return;
+        }
+        // a version number is only unique within one instance of an array, dropping and recreating it starts over
+        map<string, pair<int64_t, int64_t> > ids;
+        if (_client->getArrayIds(ids) != SUCCESS || ids.find(_array.name) == ids.end()) {
+            _cacheContext = _cache.uniqueContext();
+            return;
+        }
+        string source = _client->getSourceExpression(_array);
+
+        stringstream sig;
+        sig << _client->_host << "|" << source << ShimClient::getReferencedArrayIds(source, ids, false);
+        sig << "|" << nRasterXSize << "x" << nRasterYSize << "@" << _array.getXDim()->low << "," << _array.getYDim()->low << "|"
+            << nBands;
+        if (nBands > 0) {
+            int nBlockXSize, nBlockYSize;
+            GetRasterBand(1)->GetBlockSize(&nBlockXSize, &nBlockYSize);
+            sig << "|" << nBlockXSize << "x" << nBlockYSize;
+        }
+        QueryParameters* qp = _client->_qp;
+        if (qp != NULL) {
+            sig << "|" << qp->filter << "|" << qp->reducer << "|" << qp->hasTemporalIndex << ":" << qp->temp_index << "|"
+                << qp->hasTemporalRange << ":" << qp->lower_bound << "-" << qp->upper_bound << "|" << qp->useOccupancy
+                << qp->useMask;
+            for (size_t i = 0; i < qp->apply_names.size(); ++i)
+                sig << "|" << qp->apply_names[i] << "=" << qp->apply_exprs[i];
+        }
+        for (size_t i = 0; i < _slices.size(); ++i)
+            sig << (i == 0 ? "|" : ",") << _slices[i];
+        _cacheContext = _cache.context(sig.str());
+    }
+
+    const vector<int64_t>* SciDBDataset::populatedTIndexes() {
+        SciDBSpatioTemporalArray* starray = dynamic_cast<SciDBSpatioTemporalArray*>(&_array);
+        if (!starray || !_useOccupancy)
+            return NULL;
+        if (!_tIndexesLoaded) {
+            _tIndexesLoaded = true;
+            _tIndexesValid = _client->getTemporalIndexes(*starray, _tIndexes) == SUCCESS;
+            if (!_tIndexesValid)
+                Utils::warn("Cannot determine empty temporal slices, all slices will be read");
+        }
+        return _tIndexesValid ? &_tIndexes : NULL;
+    }
+
+    bool SciDBDataset::isBlockEmpty(int nBlockXOff, int nBlockYOff, int nBlockXSize, int nBlockYSize) {
+        if (!_useOccupancy)
+            return false;
+
+        const int R = SCIDB4GDAL_OCCUPANCY_REGION_BLOCKS;
+        if (_occupancy.empty()) {
+            _nBlocksX = (nRasterXSize + nBlockXSize - 1) / nBlockXSize;
+            _nBlocksY = (nRasterYSize + nBlockYSize - 1) / nBlockYSize;
+            _occupancy.assign((size_t)_nBlocksX * _nBlocksY, false);
+            _occupancyLoaded.assign((size_t)((_nBlocksX + R - 1) / R) * ((_nBlocksY + R - 1) / R), false);
+        }
+
+        size_t region = (size_t)(nBlockYOff / R) * ((_nBlocksX + R - 1) / R) + nBlockXOff / R;
+        if (!_occupancyLoaded[region]) {
+            int64_t xmin = (int64_t)(nBlockXOff / R) * R * nBlockXSize + _array.getXDim()->low;
+            int64_t ymin = (int64_t)(nBlockYOff / R) * R * nBlockYSize + _array.getYDim()->low;
+            int64_t xmax = std::min(xmin + R * nBlockXSize - 1, _array.getXDim()->high);
+            int64_t ymax = std::min(ymin + R * nBlockYSize - 1, _array.getYDim()->high);
+
+            vector<int64_t> blocks;
+            if (_client->getBlockOccupancy(_array, xmin, ymin, xmax, ymax, nBlockXSize, nBlockYSize, blocks) != SUCCESS) {
+                Utils::warn("Cannot determine empty blocks, all blocks will be queried");
+                _useOccupancy = false;
+                return false;
+            }
+            for (size_t i = 0; i + 1 < blocks.size(); i += 2) {
+                if (blocks[i] < 0 || blocks[i] >= _nBlocksX || blocks[i + 1] < 0 || blocks[i + 1] >= _nBlocksY)
+                    continue;
+                _occupancy[blocks[i + 1] * _nBlocksX + blocks[i]] = true;
+            }
+            _occupancyLoaded[region] = true;
+        }
+        return !_occupancy[(size_t)nBlockYOff * _nBlocksX + nBlockXOff];
+    }
+
     SciDBDataset::~SciDBDataset() {
         FlushCache();
+        Utils::debug("Tile cache: " + _cache.stats());
+        delete _maskBand;
+        if (!_materializedArray.empty()) {
+            _client->releaseMaterializedQuery(_materializedArray);
+        }
         delete _client;
     }
 
@@ -721,17 +1514,23 @@ namespace scidb4gdal {
         uint8_t* bandInterleavedChunk =
             (uint8_t*)malloc(totalSize); // This is a byte array
 
-        uint32_t nBlockX = (uint32_t)(nXSize / array.getXDim()->chunksize);
+        // one buffer for all bands and chunks, large enough for the widest attribute
+        size_t maxAttrSize = 0;
+        for (uint32_t i = 0; i < array.attrs.size(); ++i)
+            maxAttrSize = std::max(maxAttrSize, Utils::scidbTypeIdBytes(array.attrs[i].typeId));
+        void* blockBandBuf = malloc(maxAttrSize * array.getXDim()->chunksize * array.getYDim()->chunksize);
+
+        uint64_t nBlockX = (uint64_t)(nXSize / array.getXDim()->chunksize);
         if (nXSize % array.getXDim()->chunksize != 0)
             ++nBlockX;
 
-        uint32_t nBlockY = (uint32_t)(nYSize / array.getYDim()->chunksize);
+        uint64_t nBlockY = (uint64_t)(nYSize / array.getYDim()->chunksize);
         if (nYSize % array.getYDim()->chunksize != 0)
             ++nBlockY;
 
         // upload array in chunks
-        for (uint32_t bx = 0; bx < nBlockX; ++bx) {
-            for (uint32_t by = 0; by < nBlockY; ++by) {
+        for (uint64_t bx = 0; bx < nBlockX; ++bx) {
+            for (uint64_t by = 0; by < nBlockY; ++by) {
                 size_t bandOffset = 0; // sum of bytes taken by previous bands, will be
                 // updated in loop over bands
 
@@ -741,19 +1540,21 @@ namespace scidb4gdal {
                     Utils::debug("Interruption by user requested, trying to clean up");
                     // Clean up intermediate arrays
                     client->removeArray(array.name);
+                    free(blockBandBuf);
+                    free(bandInterleavedChunk);
                     throw ERR_CREATE_TERMINATEDBYUSER;
                 }
 
                 // 1. Compute array bounds from block offsets
-                int xmin = bx * array.getXDim()->chunksize + array.getXDim()->low;
-                int xmax = xmin + array.getXDim()->chunksize - 1;
+                int64_t xmin = bx * array.getXDim()->chunksize + array.getXDim()->low;
+                int64_t xmax = xmin + array.getXDim()->chunksize - 1;
                 if (xmax > array.getXDim()->high)
                     xmax = array.getXDim()->high;
                 if (xmin > array.getXDim()->high)
                     xmin = array.getXDim()->high;
 
-                int ymin = by * array.getYDim()->chunksize + array.getYDim()->low;
-                int ymax = ymin + array.getYDim()->chunksize - 1;
+                int64_t ymin = by * array.getYDim()->chunksize + array.getYDim()->low;
+                int64_t ymax = ymin + array.getYDim()->chunksize - 1;
                 if (ymax > array.getYDim()->high)
                     ymax = array.getYDim()->high;
                 if (ymin > array.getYDim()->high)
@@ -762,19 +1563,17 @@ namespace scidb4gdal {
                 // We assume reading whole blocks of individual bands first is more
                 // efficient than reading single band pixels subsequently
                 for (uint16_t iBand = 0; iBand < nBands; ++iBand) {
-                    void* blockBandBuf =
-                        malloc((1 + xmax - xmin) * (1 + ymax - ymin) *
-                            Utils::scidbTypeIdBytes(array.attrs[iBand].typeId));
-
                     // Using nPixelSpace and nLineSpace arguments could maybe automatically
                     // write to bandInterleavedChunk properly
                     GDALRasterBand* poBand = poSrcDS->GetRasterBand(iBand + 1);
                     // poBand->RasterIO ( GF_Read, ymin, xmin, 1 + ymax - ymin, 1 + xmax -
                     // xmin, ( void * ) blockBandBuf,  1 + ymax - ymin, 1 + xmax - xmin,
                     // Utils::scidbTypeIdToGDALType ( array.attrs[iBand].typeId ), 0, 0 );
+                    // array coordinates may start anywhere, image offsets always start at 0
                     poBand->RasterIO(
-                        GF_Read, xmin, ymin, 1 + xmax - xmin, 1 + ymax - ymin,
-                        (void*)blockBandBuf, 1 + xmax - xmin, 1 + ymax - ymin,
+                        GF_Read, (int)(xmin - array.getXDim()->low), (int)(ymin - array.getYDim()->low),
+                        (int)(1 + xmax - xmin), (int)(1 + ymax - ymin),
+                        (void*)blockBandBuf, (int)(1 + xmax - xmin), (int)(1 + ymax - ymin),
                         Utils::scidbTypeIdToGDALType(array.attrs[iBand].typeId), 0, 0,
                         NULL);
 
@@ -783,18 +1582,19 @@ namespace scidb4gdal {
                     block-wise interleaving manually. */
 
                     // Variable (unknown) data types and band numbers make this somewhat ugly
-                    for (int i = 0; i < (1 + xmax - xmin) * (1 + ymax - ymin); ++i) {
+                    for (int64_t i = 0; i < (1 + xmax - xmin) * (1 + ymax - ymin); ++i) {
                         memcpy(&((char*)bandInterleavedChunk)[i * pixelSize + bandOffset],
                             &((char*)blockBandBuf)[i * Utils::scidbTypeIdBytes(
                                                             array.attrs[iBand].typeId)],
                             Utils::scidbTypeIdBytes(array.attrs[iBand].typeId));
                     }
-                    free(blockBandBuf);
                     bandOffset += Utils::scidbTypeIdBytes(array.attrs[iBand].typeId);
                 }
 
                 if (client->insertData(array, bandInterleavedChunk, xmin, ymin, xmax,
                                     ymax) != SUCCESS) {
+                    free(blockBandBuf);
+                    free(bandInterleavedChunk);
                     Utils::debug("Copying data to SciDB array failed, trying to recover "
                                 "initial state...");
                     if (client->removeArray(array.name) != SUCCESS) {
@@ -806,9 +1606,53 @@ namespace scidb4gdal {
             }
         }
 
+        free(blockBandBuf);
         free(bandInterleavedChunk);
     }
 
+    void SciDBDataset::warmCache(GDALDataset* poSrcDS) {
+        if (nBands != poSrcDS->GetRasterCount() || nRasterXSize != poSrcDS->GetRasterXSize() ||
+            nRasterYSize != poSrcDS->GetRasterYSize())
+            return;
+
+        int nBlockXSize, nBlockYSize;
+        GetRasterBand(1)->GetBlockSize(&nBlockXSize, &nBlockYSize);
+        int nBlocksX = nBlocksPerRow(nBlockXSize);
+        int nBlocksY = nBlocksPerColumn(nBlockYSize);
+        size_t budget = cacheBudget();
+        size_t used = 0;
+
+        // row by row, such that a partially warmed cache serves scanline oriented readers from the top
+        for (int by = 0; by < nBlocksY; ++by) {
+            for (int bx = 0; bx < nBlocksX; ++bx) {
+                int xoff = bx * nBlockXSize;
+                int yoff = by * nBlockYSize;
+                int w = std::min(nBlockXSize, nRasterXSize - xoff);
+                int h = std::min(nBlockYSize, nRasterYSize - yoff);
+                for (int iBand = 0; iBand < nBands; ++iBand) {
+                    size_t nbytes = Utils::scidbTypeIdBytes(_array.attrs[iBand].typeId);
+                    size_t size = (size_t)nBlockXSize * nBlockYSize * nbytes;
+                    if (used + size > budget) {
+                        Utils::debug("Tile cache filled with the first " + boost::lexical_cast<string>(by) +
+                                     " block rows of the uploaded image");
+                        return;
+                    }
+                    void* block = _cache.pool().acquire(size);
+                    if (w < nBlockXSize || h < nBlockYSize)
+                        memset(block, 0, size);
+                    if (poSrcDS->GetRasterBand(iBand + 1)->RasterIO(
+                            GF_Read, xoff, yoff, w, h, block, w, h, Utils::scidbTypeIdToGDALType(_array.attrs[iBand].typeId),
+                            nbytes, (GSpacing)nBlockXSize * nbytes, NULL) != CE_None) {
+                        _cache.pool().release(block, size);
+                        return;
+                    }
+                    ((SciDBRasterBand*)GetRasterBand(iBand + 1))->cacheBlock(bx, by, iBand, block, size);
+                    used += size;
+                }
+            }
+        }
+    }
+
     bool SciDBDataset::arrayIntegrateable(SciDBSpatialArray& src_array, SciDBSpatialArray& tar_array) {
         bool sameSRS = (src_array.auth_srid == tar_array.auth_srid) &&  boost::iequals(src_array.auth_name, tar_array.auth_name);
 
@@ -1121,6 +1965,9 @@ namespace scidb4gdal {
             }
             Utils::debug("-- DONE");
 
+            // only freshly created 2d arrays contain exactly the source image afterwards
+            bool warmable = create_pars->warmCache && create_pars->type == S_ARRAY && src_array == tar_arr;
+
             string arrayName = src_array->name;
             string tempArrayName = src_array->name + SCIDB4GDAL_ARRAYSUFFIX_TEMP;
             string insertableName = src_array->name + "_insertable";
@@ -1249,12 +2096,24 @@ namespace scidb4gdal {
                 src_array = tar_arr;
             }
 
-            pfnProgress(1.0, NULL, pProgressData);
+            // inserted slices change the temporal occupancy index stored in the array metadata
+            if (create_pars->type == ST_ARRAY || create_pars->type == ST_SERIES) {
+                SciDBSpatioTemporalArray* st_array = (SciDBSpatioTemporalArray*)src_array;
+                vector<int64_t> tindexes;
+                if (client->getArrayVersion(st_array->name, st_array->version) == SUCCESS)
+                    client->getTemporalIndexes(*st_array, tindexes, true);
+            }
 
             if (tar_arr && tar_arr != src_array)
                 delete tar_arr;
 
-            return new SciDBDataset(*src_array, client);
+            SciDBDataset* poDS = new SciDBDataset(*src_array, client);
+            if (warmable)
+                poDS->warmCache(poSrcDS);
+
+            pfnProgress(1.0, NULL, pProgressData);
+
+            return poDS;
         } catch (StatusCode e) {
             // catch exceptions and give information back to the user
             switch (e) {
@@ -1406,6 +2265,19 @@ namespace scidb4gdal {
             
 
             client->setQueryParameters(*query_pars);
+
+            // results of AFL queries are materialized once and afterwards read like stored arrays
+            bool materialized = false;
+            if (!con_pars->query.empty()) {
+                if (client->materializeQuery(con_pars->query, con_pars->arrayname) != SUCCESS) {
+                    Utils::error("Cannot materialize query result");
+                    delete client;
+                    return NULL;
+                }
+                materialized = true;
+            }
+            // released on all error paths below, until a dataset takes over the result
+            MaterializedQueryGuard guard(client, materialized ? con_pars->arrayname : "");
             
 
             // create simple array here and cast it later if needed
@@ -1419,28 +2291,101 @@ namespace scidb4gdal {
                 Utils::debug("array changes not afflicting the 'scidbdriver'");
             }
 
+            // pin all reads to one array version, such that concurrent inserts do not mix into the dataset
+            if (!materialized) {
+                int64_t current = 0;
+                client->getArrayVersion(array->name, current);
+                if (query_pars->version > current || query_pars->version == 0) {
+                    Utils::error("Array version " + boost::lexical_cast<string>(query_pars->version) + " does not exist, most recent version is " +
+                                 boost::lexical_cast<string>(current));
+                    return NULL;
+                }
+                array->version = (query_pars->version > 0) ? query_pars->version : current;
+            }
+
+            // attributes of further arrays on the same grid are read with the same queries using join()
+            for (size_t i = 0; i < con_pars->joinarrays.size(); ++i) {
+                SciDBSpatialArray* other;
+                if (client->getArrayDesc(con_pars->joinarrays[i], other) != SUCCESS) {
+                    Utils::error("Cannot fetch metadata of array '" + con_pars->joinarrays[i] + "'");
+                    return NULL;
+                }
+                bool sameGrid = other->dims.size() == array->dims.size() &&
+                                other->affineTransform.toString() == array->affineTransform.toString() &&
+                                arrayIntegrateable(*other, *array) && arrayIntegrateable(*array, *other);
+                for (uint32_t d = 0; sameGrid && d < array->dims.size(); ++d) {
+                    sameGrid = other->dims[d].start == array->dims[d].start && other->dims[d].length == array->dims[d].length &&
+                               other->dims[d].chunksize == array->dims[d].chunksize;
+                }
+                if (!sameGrid) {
+                    Utils::error("Array '" + other->name + "' does not share the grid and chunking of array '" + array->name + "'");
+                    delete other;
+                    return NULL;
+                }
+                StatusCode res = client->joinArray(*array, *other);
+                delete other;
+                if (res != SUCCESS)
+                    return NULL;
+            }
+
+            // derived attributes replace the array's attributes as bands
+            if (!query_pars->apply_names.empty()) {
+                if (client->getDerivedAttributeDesc(client->getSourceExpression(*array), array->attrs) != SUCCESS) {
+                    Utils::error("Cannot evaluate apply expressions");
+                    return NULL;
+                }
+            }
+
+            // the image starts at the origin of the chunk containing the lowest cell, blocks then match chunks exactly
+            if (query_pars->alignBlocks) {
+                SciDBDimension* sdims[2] = {array->getXDim(), array->getYDim()};
+                for (int i = 0; i < 2; ++i) {
+                    SciDBDimension* d = sdims[i];
+                    if (d->chunksize > 0 && d->low > d->start)
+                        d->low = d->start + ((d->low - d->start) / d->chunksize) * (int64_t)d->chunksize;
+                }
+            }
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 1, 0)
+            // the multidimensional API exposes all dimensions, hence temporal selections and reducers are not applied
+            if (poOpenInfo->nOpenFlags & GDAL_OF_MULTIDIM_RASTER) {
+                return new SciDBMultiDimDataset(array, client, guard.release());
+            }
+#endif
+
             // try to cast the array. if not possible then it is null and the temporal
             // parameter setting is skipped
             SciDBSpatioTemporalArray* starray_ptr = dynamic_cast<SciDBSpatioTemporalArray*>(array);
             if (starray_ptr) {
                 Utils::debug("Type Cast OK. Start setting up temporal information");
+                // get dimension for time
+                SciDBDimension* dim = starray_ptr->getTDim();
+
                 // check if the temporal index was set or if a timestamp was used
-                if (query_pars->hasTemporalIndex) {
-                    Utils::debug("Has index...");
-                    char* t_index_key = new char[1];
-                    t_index_key[0] = 't';
-                    if (CSLFindName(poOpenInfo->papszOpenOptions, t_index_key) >= 0) {
-                        string value = CSLFetchNameValue(poOpenInfo->papszOpenOptions, t_index_key);
-                        Utils::debug("Casting temporal index");
-                        query_pars->temp_index = boost::lexical_cast<int>(value);
-                        Utils::debug("done");
+                if (query_pars->hasTemporalRange) {
+                    if (query_pars->timestamp.length() > 0) {
+                        Utils::debug("Transform temporal interval to indexes");
+                        TPoint t0 = TPoint(query_pars->timestamp);
+                        TPoint t1 = TPoint(query_pars->timestamp_end);
+                        query_pars->lower_bound = starray_ptr->indexAtDatetime(t0);
+                        query_pars->upper_bound = starray_ptr->indexAtDatetime(t1);
                     }
+                    if (query_pars->lower_bound < dim->low)
+                        query_pars->lower_bound = dim->low;
+                    if (query_pars->upper_bound > dim->high)
+                        query_pars->upper_bound = dim->high;
+                    if (query_pars->lower_bound > query_pars->upper_bound) {
+                        Utils::error("Specified temporal interval does not intersect the array's temporal extent");
+                        return NULL;
+                    }
+                } else if (query_pars->hasTemporalIndex) {
+                    Utils::debug("Has index...");
                 } else {
                     // convert date to temporal index
                     Utils::debug("Converting date to index");
                     if (query_pars->timestamp.length() == 0) {
                         Utils::warn("No temporal index and no timestamp provided. Using first temporal index instead");
-                        query_pars->temp_index = -1;
+                        query_pars->temp_index = dim->low;
                         query_pars->hasTemporalIndex = false;
                     } else {
                         Utils::debug("Transform date to index");
@@ -1450,10 +2395,23 @@ namespace scidb4gdal {
                     }
                 }
 
-                // get dimension for time
-                SciDBDimension* dim;
-                // dim = &starray_ptr->dims[starray_ptr->getTDimIdx()];
-                dim = starray_ptr->getTDim();
+                // composites without explicit interval reduce the complete temporal dimension
+                if (!query_pars->reducer.empty()) {
+                    if (!query_pars->hasTemporalRange) {
+                        query_pars->lower_bound = dim->low;
+                        query_pars->upper_bound = dim->high;
+                        query_pars->hasTemporalRange = true;
+                        query_pars->hasTemporalIndex = false;
+                    }
+                    // reduced attributes may contain empty pixels, mean and median are computed as double
+                    for (uint32_t i = 0; i < array->attrs.size(); ++i) {
+                        array->attrs[i].nullable = true;
+                        if (query_pars->reducer == "mean" || query_pars->reducer == "median") {
+                            array->attrs[i].sourceTypeId = array->attrs[i].typeId;
+                            array->attrs[i].typeId = "double";
+                        }
+                    }
+                }
 
                 if (query_pars->hasTemporalIndex) {
                     if (query_pars->temp_index < dim->low ||
@@ -1476,10 +2434,18 @@ namespace scidb4gdal {
                 }*/
             }
 
+            else if (!query_pars->reducer.empty()) {
+                Utils::warn("Temporal composites can only be computed for spacetime arrays, ignoring reducer");
+                query_pars->reducer = "";
+            }
+
             // Create the dataset
 
             SciDBDataset* poDS;
             poDS = new SciDBDataset(*array, client);
+            if (materialized) {
+                poDS->_materializedArray = guard.release();
+            }
             return (poDS);
         } catch (int e) {
             switch (e) {
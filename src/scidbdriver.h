@@ -35,6 +35,7 @@ namespace scidb4gdal {
     using namespace scidb4geo;
 
     class SciDBRasterBand;
+    class SciDBMaskBand;
     class SciDBDataset;
 
     /**
@@ -50,6 +51,7 @@ namespace scidb4gdal {
     */
     class SciDBDataset : public GDALDataset {
         friend class SciDBRasterBand;
+        friend class SciDBMaskBand;
 
     private:
         /**
@@ -64,10 +66,139 @@ namespace scidb4gdal {
         ShimClient* _client;
         
         /**
-        * the tile cache used for downloading chunked array data and to temporarily
+        * the process-wide tile cache used for downloading chunked array data and to temporarily
         * storing it before writing to a file
         */
-        TileCache _cache;
+        SharedTileCache& _cache;
+
+        /**
+        * context of this dataset's tiles in the shared cache, shared with other datasets reading the same array version
+        * with the same options
+        */
+        uint64_t _cacheContext;
+
+        /**
+        * whether or not blocks are cached in GDAL's block cache only, instead of the process-wide cache
+        */
+        bool _useGDALCache;
+
+        /**
+        * @brief Returns the size of the cache that holds downloaded blocks in bytes
+        */
+        size_t cacheBudget() const { return _useGDALCache ? (size_t)GDALGetCacheMax64() : _cache.maxSize(); }
+
+        /**
+        * name of the temporary array holding a materialized query result that is released when the dataset is closed,
+        * empty if the dataset does not read a query result
+        */
+        string _materializedArray;
+
+        /**
+        * whether or not empty blocks are detected with the block occupancy map
+        */
+        bool _useOccupancy;
+
+        /**
+        * bitmap of non-empty blocks, row-major, filled lazily per region of SCIDB4GDAL_OCCUPANCY_REGION_BLOCKS x
+        * SCIDB4GDAL_OCCUPANCY_REGION_BLOCKS blocks
+        */
+        vector<bool> _occupancy;
+
+        /**
+        * bitmap of regions whose block occupancy has been loaded, row-major
+        */
+        vector<bool> _occupancyLoaded;
+
+        /**
+        * number of blocks in x and y direction as used by the occupancy map
+        */
+        int _nBlocksX, _nBlocksY;
+
+        /**
+        * mask band of empty cells shared by all bands, NULL if not requested with the mask opening option
+        */
+        SciDBMaskBand* _maskBand;
+
+        /**
+        * temporal indexes represented by the bands of a dataset covering a temporal range, in band order
+        */
+        vector<int64_t> _slices;
+
+        /**
+        * sorted temporal indexes of the array that contain data, see populatedTIndexes()
+        */
+        vector<int64_t> _tIndexes;
+
+        /**
+        * whether or not loading _tIndexes has been tried, and whether it succeeded
+        */
+        bool _tIndexesLoaded, _tIndexesValid;
+
+        /**
+        * @brief Returns the temporal indexes of a spacetime array that contain data
+        *
+        * The index is loaded on first access, from the array metadata if it matches the array version, otherwise with
+        * one aggregate query.
+        *
+        * @return sorted temporal indexes, NULL if the array is not a spacetime array, occupancy detection is disabled,
+        * or the index cannot be determined
+        */
+        const vector<int64_t>* populatedTIndexes();
+
+        /**
+        * @brief Derives the context of the dataset's tiles in the shared cache
+        *
+        * The signature covers the server, the array expression including its version, the instance ids of all arrays in
+        * it, all options that change cell values, and the band and block layout. Arrays without versions or ids get a
+        * context of their own, since their content may change between datasets.
+        */
+        void initCacheContext();
+
+        /**
+        * @brief Chooses the block size of the dataset's bands
+        *
+        * Block sizes are multiples or divisors of the chunk size. Unless the blocksize opening option is given, the size
+        * is chosen such that a block of the largest attribute type comes close to request_mb megabytes, which keeps the
+        * HTTP overhead of small chunks low and huge chunks within the cache.
+        *
+        * @param nBlockXSize block size in x direction (output)
+        * @param nBlockYSize block size in y direction (output)
+        */
+        void computeBlockSize(int& nBlockXSize, int& nBlockYSize) const;
+
+        /**
+        * @brief Fills the tile cache with blocks of the source image of CreateCopy
+        *
+        * Blocks are read from the source in the block grid of this dataset, row by row, until the cache budget is used.
+        * Only valid if the dataset's array contains exactly the source image, i.e. after creating a new 2d array.
+        *
+        * @param poSrcDS the uploaded image
+        */
+        void warmCache(GDALDataset* poSrcDS);
+
+        /**
+        * @brief Checks whether a block is known to contain no cells
+        *
+        * Loads the occupancy of the block's region with a single count(*) query on first access. If the occupancy cannot be
+        * determined, all blocks are assumed to contain data.
+        *
+        * @param nBlockXOff the column offset of the block
+        * @param nBlockYOff the row offset of the block
+        * @param nBlockXSize block size in x direction
+        * @param nBlockYSize block size in y direction
+        * @return bool true if the block is empty
+        */
+        bool isBlockEmpty(int nBlockXOff, int nBlockYOff, int nBlockXSize, int nBlockYSize);
+
+        /**
+        * @brief Returns the number of blocks per row for a given block width, as needed for unique tile ids
+        */
+        int nBlocksPerRow(int nBlockXSize) const { return (nRasterXSize + nBlockXSize - 1) / nBlockXSize; }
+
+        /**
+        * @brief Returns the number of blocks per column for a given block height, as needed for unique tile ids
+        */
+        int nBlocksPerColumn(int nBlockYSize) const { return (nRasterYSize + nBlockYSize - 1) / nBlockYSize; }
         
 
         /**
@@ -250,6 +381,101 @@ namespace scidb4gdal {
 
         SciDBSpatialArray* _array; //!< associated array metadata object
         char** papszMetadata;
+        string _drillResult; //!< result of the last time series, point or zonal statistics request, returned by GetMetadataItem
+        int _nAttr; //!< index of the array attribute represented by this band, 0 based
+        int64_t _tIndex; //!< temporal index of the represented slice if the dataset covers a temporal range, -1 otherwise
+
+        /**
+        * @brief Checks whether a block of a band of the dataset is cached, in GDAL's or the driver's cache
+        *
+        * @param nBlockXOff the column offset of the block
+        * @param nBlockYOff the row offset of the block
+        * @param iBand the band index, 0 based
+        * @return bool
+        */
+        bool isBlockCached(int nBlockXOff, int nBlockYOff, int iBand);
+
+        /**
+        * @brief Caches a prefetched block of a band of the dataset, in GDAL's or the driver's cache
+        *
+        * @param nBlockXOff the column offset of the block
+        * @param nBlockYOff the row offset of the block
+        * @param iBand the band index, 0 based
+        * @param data block data of full block size, ownership is taken
+        * @param size size of the block in bytes
+        */
+        void cacheBlock(int nBlockXOff, int nBlockYOff, int iBand, void* data, size_t size);
+
+        /**
+        * @brief Fetches a block together with its right neighbours in one query
+        *
+        * Neighbours are added until a block is cached already or empty, or SCIDB4GDAL_COALESCE_MAX_BLOCKS is reached.
+        * The requested block is written to tile, the others are added to the dataset's TileCache.
+        *
+        * @param nBlockXOff the column offset as a number
+        * @param nBlockYOff the row offset as a number
+        * @param ymin lower boundary of the block in array coordinates
+        * @param ymax upper boundary of the block in array coordinates
+        * @param tile preallocated tile of full block size (output)
+        * @return CPLErr
+        */
+        CPLErr fetchBlockRow(int nBlockXOff, int nBlockYOff, int64_t ymin, int64_t ymax, ArrayTile& tile);
+
+        /**
+        * @brief Fetches a row of blocks of all attributes of joined arrays in one query
+        *
+        * The block of this band is written to tile, blocks of the other bands are added to the cache unless cached already.
+        *
+        * @param nBlockXOff the column offset of the first block
+        * @param nBlockYOff the row offset of the blocks
+        * @param nBlocks number of blocks
+        * @param xmin left boundary of the blocks in array coordinates
+        * @param ymin lower boundary of the blocks in array coordinates
+        * @param xmax right boundary of the blocks in array coordinates
+        * @param ymax upper boundary of the blocks in array coordinates
+        * @param tile preallocated tile of full block size (output)
+        * @return CPLErr
+        */
+        CPLErr fetchJoinedBlockRow(int nBlockXOff, int nBlockYOff, int nBlocks, int64_t xmin, int64_t ymin, int64_t xmax,
+                                   int64_t ymax, ArrayTile& tile);
+
+        /**
+        * @brief Fetches a block of all slices within the same temporal chunk in one query
+        *
+        * Used for datasets opened with a temporal range. The block of this band's slice is written to tile, blocks of the
+        * other slices are added to the dataset's TileCache.
+        *
+        * @param nBlockXOff the column offset as a number
+        * @param nBlockYOff the row offset as a number
+        * @param xmin left boundary of the block in array coordinates
+        * @param ymin lower boundary of the block in array coordinates
+        * @param xmax right boundary of the block in array coordinates
+        * @param ymax upper boundary of the block in array coordinates
+        * @param tile preallocated tile of full block size (output)
+        * @return CPLErr
+        */
+        CPLErr fetchSlices(int nBlockXOff, int nBlockYOff, int64_t xmin, int64_t ymin, int64_t xmax, int64_t ymax, ArrayTile& tile);
+
+        /**
+        * @brief Fetches the values of several cells with a single query
+        *
+        * @param cells array coordinates as x, y pairs, may contain duplicates
+        * @param values cell values as double, one per cell (output)
+        * @return CPLErr
+        */
+        CPLErr fetchPointValues(const vector<int64_t>& cells, vector<double>& values);
+
+        /**
+        * @brief Computes statistics of this band per zone of a zone raster in the database
+        *
+        * The first band of the zone raster is read as 32 bit integer zone ids and must be aligned to the pixel grid of
+        * the dataset. Only the part overlapping the dataset is uploaded.
+        *
+        * @param zoneFile name of a GDAL dataset with zone ids
+        * @param out CSV table with header line zone,count,sum,mean,stdev,min,max (output)
+        * @return CPLErr
+        */
+        CPLErr fetchZonalStatistics(const string& zoneFile, string& out);
 
     public:
         /**
@@ -257,9 +483,10 @@ namespace scidb4gdal {
         *
         * @param poDS the parent dataset
         * @param array the metadata representation of the array
-        * @param nBand the number of the band in the data set
+        * @param nBand the index of the represented array attribute, 0 based
+        * @param tIndex the temporal index of the represented slice for datasets covering a temporal range, -1 otherwise
         */
-        SciDBRasterBand(SciDBDataset* poDS, SciDBSpatialArray* array, int nBand);
+        SciDBRasterBand(SciDBDataset* poDS, SciDBSpatialArray* array, int nBand, int64_t tIndex = -1);
 
         /**
         * @brief Band destructor
@@ -279,6 +506,19 @@ namespace scidb4gdal {
         */
         virtual CPLErr IReadBlock(int nBlockXOff, int nBlockYOff, void* pImage);
 
+        /**
+        * @brief Reads a window, converting values server-side if a narrower integer buffer type is requested
+        *
+        * Non-resampled reads of single images into Byte, Int16 or UInt16 buffers are fetched with one query that
+        * rounds and clamps values in the database like GDAL does, such that fewer bytes are transferred. Windows whose
+        * blocks are all cached or empty, and all other requests, are handled block-wise by GDAL and yield the same values.
+        *
+        * @copydetails GDALRasterBand::IRasterIO
+        */
+        virtual CPLErr IRasterIO(GDALRWFlag eRWFlag, int nXOff, int nYOff, int nXSize, int nYSize, void* pData,
+                                 int nBufXSize, int nBufYSize, GDALDataType eBufType, GSpacing nPixelSpace,
+                                 GSpacing nLineSpace, GDALRasterIOExtraArg* psExtraArg);
+
         /*
         * GDAL function called as array attribtue data shall be written, uploads data
         * to SciDB and thus might take some time
@@ -308,6 +548,75 @@ namespace scidb4gdal {
 
         /** @copydoc GDALPamRasterBand::GetUnitType */
         virtual const char* GetUnitType();
+
+        /**
+        * @brief Fetches a single metadata item, including time series of spacetime arrays
+        *
+        * Items of the "DRILL" domain are computed on request: "Pixel_x_y" returns the complete time series of a single pixel,
+        * "Window_x_y_w_h" the time series of all pixels of a window (in image coordinates). The result consists of one line
+        * per temporal index with the ISO 8601 timestamp followed by comma separated values.
+        *
+        * Items of the "POINTS" domain are lists of world coordinates "x,y" separated by whitespace or semicolons. All values are
+        * fetched with one query and returned as one line "x,y,value" per point. "Pixel_x_y" items of the "LocationInfo" domain
+        * return the value of a single pixel as used by gdallocationinfo. All other domains are passed to GDALPamRasterBand.
+        *
+        * @param pszName the key for the metadata item to fetch
+        * @param pszDomain the domain of the metadata item
+        * @return const char* the value or NULL if not available
+        */
+        virtual const char* GetMetadataItem(const char* pszName, const char* pszDomain = "");
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(2, 2, 0)
+        /**
+        * @brief Reports whether a window contains data, based on the block occupancy map of the dataset
+        *
+        * @see GDALRasterBand::IGetDataCoverageStatus
+        */
+        virtual int IGetDataCoverageStatus(int nXOff, int nYOff, int nXSize, int nYSize, int nMaskFlagStop,
+                                           double* pdfDataPct);
+#endif
+
+        /**
+        * @brief Returns GMF_PER_DATASET if the dataset has a mask band of empty cells
+        *
+        * @see GDALRasterBand::GetMaskFlags
+        */
+        virtual int GetMaskFlags();
+
+        /**
+        * @brief Returns the mask band of empty cells if available, GDAL's default mask band otherwise
+        *
+        * @see GDALRasterBand::GetMaskBand
+        */
+        virtual GDALRasterBand* GetMaskBand();
+    };
+
+    /**
+    * GDALRasterBand subclass representing which cells exist in the array
+    *
+    * Cells that exist in SciDB are 255, empty cells are 0. Blocks are empty if the block occupancy map of the dataset says
+    * so, other blocks are fetched as bit-packed mask with one query, independent of the attributes' no data values.
+    */
+    class SciDBMaskBand : public GDALRasterBand {
+    public:
+        /**
+        * @brief Constructor with the block size of the dataset's bands
+        *
+        * @param poDS the parent dataset
+        * @param nBlockXSize block size in x direction
+        * @param nBlockYSize block size in y direction
+        */
+        SciDBMaskBand(SciDBDataset* poDS, int nBlockXSize, int nBlockYSize);
+
+        /**
+        * @brief Fetches the mask of a single block
+        *
+        * @param nBlockXOff the column offset as a number
+        * @param nBlockYOff the row offset as a number
+        * @param pImage the image where the mask is written into
+        * @return CPLErr
+        */
+        virtual CPLErr IReadBlock(int nBlockXOff, int nBlockYOff, void* pImage);
     };
 }
 
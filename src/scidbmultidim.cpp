@@ -0,0 +1,183 @@
+/*
+Copyright (c) 2016 Marius Appel <marius.appel@uni-muenster.de>
+
+This file is part of scidb4gdal. scidb4gdal is licensed under the MIT license.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+-----------------------------------------------------------------------------*/
+
+
+#include "scidbmultidim.h"
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 1, 0)
+
+#include "ogr_spatialref.h"
+
+namespace scidb4gdal {
+
+    SciDBMultiDimContext::SciDBMultiDimContext(SciDBSpatialArray* array, ShimClient* client, const string& materializedArray)
+        : array(array), client(client), materializedArray(materializedArray) {}
+
+    SciDBMultiDimContext::~SciDBMultiDimContext() {
+        if (!materializedArray.empty()) {
+            client->releaseMaterializedQuery(materializedArray);
+        }
+        delete client;
+        delete array;
+    }
+
+    SciDBMDArray::SciDBMDArray(const std::shared_ptr<SciDBMultiDimContext>& ctx,
+                               const std::vector<std::shared_ptr<GDALDimension> >& dims, int nAttr)
+        : GDALAbstractMDArray("/", ctx->array->attrs[nAttr].name), GDALMDArray("/", ctx->array->attrs[nAttr].name), _ctx(ctx),
+          _dims(dims), _dt(GDALExtendedDataType::Create(Utils::scidbTypeIdToGDALType(ctx->array->attrs[nAttr].typeId))),
+          _nAttr(nAttr) {
+        double nodata = CPLAtof(_ctx->client->getNoDataString(*_ctx->array, nAttr).c_str());
+        _noData.resize(_dt.GetSize());
+        GDALCopyWords(&nodata, GDT_Float64, 0, _noData.data(), Utils::scidbTypeIdToGDALType(ctx->array->attrs[nAttr].typeId), 0, 1);
+    }
+
+    bool SciDBMDArray::IRead(const GUInt64* arrayStartIdx, const size_t* count, const GInt64* arrayStep,
+                             const GPtrDiff_t* bufferStride, const GDALExtendedDataType& bufferDataType,
+                             void* pDstBuffer) const {
+        SciDBSpatialArray& array = *_ctx->array;
+        size_t ndims = array.dims.size();
+        vector<int64_t> start(ndims), step(ndims);
+        vector<uint64_t> cnt(ndims);
+        size_t n = 1;
+        for (size_t i = 0; i < ndims; ++i) {
+            start[i] = array.dims[i].low + (int64_t)arrayStartIdx[i];
+            step[i] = arrayStep[i];
+            cnt[i] = count[i];
+            n *= count[i];
+        }
+        if (n == 0)
+            return true;
+
+        size_t nbytes = _dt.GetSize();
+        if (n * nbytes > ((size_t)SCIDB4GDAL_MAINMEM_HARD_LIMIT_MB) * 1024 * 1024) {
+            Utils::error("Requested hyperslab exceeds the main memory limit, please read smaller parts");
+            return false;
+        }
+        std::vector<GByte> buf(n * nbytes);
+        if (_ctx->client->getHyperslab(array, _nAttr, start, cnt, step, buf.data()) != SUCCESS)
+            return false;
+
+        // the result is in row-major order, the destination buffer may have arbitrary strides and data type
+        std::vector<size_t> idx(ndims, 0);
+        size_t dstSize = bufferDataType.GetSize();
+        for (size_t k = 0; k < n; ++k) {
+            GPtrDiff_t off = 0;
+            for (size_t i = 0; i < ndims; ++i) {
+                off += (GPtrDiff_t)idx[i] * bufferStride[i];
+            }
+            GDALExtendedDataType::CopyValue(&buf[k * nbytes], _dt, (GByte*)pDstBuffer + off * (GPtrDiff_t)dstSize,
+                                            bufferDataType);
+            for (size_t i = ndims; i-- > 0;) {
+                if (++idx[i] < count[i])
+                    break;
+                idx[i] = 0;
+            }
+        }
+        return true;
+    }
+
+    std::vector<GUInt64> SciDBMDArray::GetBlockSize() const {
+        std::vector<GUInt64> out;
+        for (size_t i = 0; i < _ctx->array->dims.size(); ++i) {
+            out.push_back(_ctx->array->dims[i].chunksize);
+        }
+        return out;
+    }
+
+    std::shared_ptr<OGRSpatialReference> SciDBMDArray::GetSpatialRef() const {
+        SciDBSpatialArray& array = *_ctx->array;
+        if (array.srtext.empty())
+            return nullptr;
+        std::shared_ptr<OGRSpatialReference> srs(new OGRSpatialReference());
+        if (srs->SetFromUserInput(array.srtext.c_str()) != OGRERR_NONE)
+            return nullptr;
+        srs->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+        std::vector<int> mapping;
+        mapping.push_back(array.getXDimIdx() + 1);
+        mapping.push_back(array.getYDimIdx() + 1);
+        srs->SetDataAxisToSRSAxisMapping(mapping);
+        return srs;
+    }
+
+    SciDBMDGroup::SciDBMDGroup(const std::shared_ptr<SciDBMultiDimContext>& ctx) : GDALGroup("", "/") {
+        SciDBSpatialArray& array = *ctx->array;
+        SciDBSpatioTemporalArray* starray = dynamic_cast<SciDBSpatioTemporalArray*>(&array);
+        AffineTransform& a = array.affineTransform;
+        bool regular = (a._a12 == 0 && a._a21 == 0);
+
+        for (size_t i = 0; i < array.dims.size(); ++i) {
+            SciDBDimension& d = array.dims[i];
+            GUInt64 size = 1 + d.high - d.low;
+            if ((int)i == array.getXDimIdx() || (int)i == array.getYDimIdx()) {
+                bool isX = ((int)i == array.getXDimIdx());
+                std::shared_ptr<GDALDimension> dim(new GDALDimensionWeakIndexingVar(
+                    "/", d.name, isX ? GDAL_DIM_TYPE_HORIZONTAL_X : GDAL_DIM_TYPE_HORIZONTAL_Y,
+                    isX ? "EAST" : ((a._a22 < 0) ? "SOUTH" : "NORTH"), size));
+                if (regular) {
+                    // world coordinates of pixel centers
+                    double origin = isX ? a._x0 + a._a11 * d.low : a._y0 + a._a22 * d.low;
+                    std::shared_ptr<GDALMDArray> var =
+                        GDALMDArrayRegularlySpaced::Create("/", d.name, dim, origin, isX ? a._a11 : a._a22, 0.5);
+                    dim->SetIndexingVariable(var);
+                    _arrays.push_back(var);
+                }
+                _dims.push_back(dim);
+            } else {
+                string type = (starray && (int)i == starray->getTDimIdx()) ? GDAL_DIM_TYPE_TEMPORAL : "";
+                _dims.push_back(std::shared_ptr<GDALDimension>(new GDALDimension("/", d.name, type, "", size)));
+            }
+        }
+
+        for (size_t i = 0; i < array.attrs.size(); ++i) {
+            std::shared_ptr<SciDBMDArray> arr(new SciDBMDArray(ctx, _dims, (int)i));
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 2, 0)
+            arr->SetSelf(arr);
+#endif
+            _arrays.push_back(arr);
+        }
+    }
+
+    std::vector<std::string> SciDBMDGroup::GetMDArrayNames(CSLConstList) const {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < _arrays.size(); ++i) {
+            names.push_back(_arrays[i]->GetName());
+        }
+        return names;
+    }
+
+    std::shared_ptr<GDALMDArray> SciDBMDGroup::OpenMDArray(const std::string& osName, CSLConstList) const {
+        for (size_t i = 0; i < _arrays.size(); ++i) {
+            if (_arrays[i]->GetName() == osName)
+                return _arrays[i];
+        }
+        return nullptr;
+    }
+
+    SciDBMultiDimDataset::SciDBMultiDimDataset(SciDBSpatialArray* array, ShimClient* client, const string& materializedArray) {
+        std::shared_ptr<SciDBMultiDimContext> ctx(new SciDBMultiDimContext(array, client, materializedArray));
+        _rootGroup.reset(new SciDBMDGroup(ctx));
+    }
+}
+
+#endif
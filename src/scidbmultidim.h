@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2016 Marius Appel <marius.appel@uni-muenster.de>
+
+This file is part of scidb4gdal. scidb4gdal is licensed under the MIT license.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+-----------------------------------------------------------------------------*/
+
+
+#ifndef SCIDB_MULTIDIM_H
+#define SCIDB_MULTIDIM_H
+
+#include "utils.h"
+#include "shimclient.h"
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 1, 0)
+
+#include <memory>
+
+namespace scidb4gdal {
+
+    /**
+    * @brief Array metadata and Shim client shared by all objects of a multidimensional dataset
+    *
+    * Groups, arrays and dimensions may outlive the dataset they have been opened from, hence the client is owned by this
+    * context and released as soon as the last object referring to it is destroyed.
+    */
+    struct SciDBMultiDimContext {
+        /**
+        * @brief Takes ownership of the array metadata and the client
+        *
+        * @param array metadata of an existing array
+        * @param client client connected to the database
+        * @param materializedArray temporary array holding a materialized query result that is released with the context
+        */
+        SciDBMultiDimContext(SciDBSpatialArray* array, ShimClient* client, const string& materializedArray);
+
+        /**
+        * @brief Releases the materialized array, if any, and the client
+        */
+        ~SciDBMultiDimContext();
+
+        SciDBSpatialArray* array; //!< array metadata, including all dimensions
+        ShimClient* client; //!< client used for all queries
+        string materializedArray; //!< materialized query result to be released, empty if none
+    };
+
+    /**
+    * @brief A single array attribute as N-dimensional GDALMDArray
+    *
+    * Hyperslabs over all dimensions of the array, including time and further dimensions, are fetched with one query each.
+    * Dimension indexes start at the lowest existing coordinate of the dimension, as for raster bands.
+    */
+    class SciDBMDArray : public GDALMDArray {
+        std::shared_ptr<SciDBMultiDimContext> _ctx;
+        std::vector<std::shared_ptr<GDALDimension> > _dims;
+        GDALExtendedDataType _dt;
+        int _nAttr;
+        std::vector<GByte> _noData;
+
+    protected:
+        /** @copydoc GDALAbstractMDArray::IRead */
+        bool IRead(const GUInt64* arrayStartIdx, const size_t* count, const GInt64* arrayStep,
+                   const GPtrDiff_t* bufferStride, const GDALExtendedDataType& bufferDataType, void* pDstBuffer) const override;
+
+    public:
+        /**
+        * @brief Constructor for an array attribute
+        *
+        * @param ctx shared context of the dataset
+        * @param dims dimensions of the array in SciDB order
+        * @param nAttr index of the attribute, 0 based
+        */
+        SciDBMDArray(const std::shared_ptr<SciDBMultiDimContext>& ctx, const std::vector<std::shared_ptr<GDALDimension> >& dims,
+                     int nAttr);
+
+        bool IsWritable() const override { return false; }
+
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 8, 0)
+        const std::string& GetFilename() const override { return _ctx->array->name; }
+#endif
+
+        const std::vector<std::shared_ptr<GDALDimension> >& GetDimensions() const override { return _dims; }
+
+        const GDALExtendedDataType& GetDataType() const override { return _dt; }
+
+        /**
+        * @brief Returns the no data value of the attribute, which is also used for empty cells
+        */
+        const void* GetRawNoDataValue() const override { return _noData.data(); }
+
+        /**
+        * @brief Returns the chunk sizes of the SciDB array, reads aligned to these are most efficient
+        */
+        std::vector<GUInt64> GetBlockSize() const override;
+
+        /**
+        * @brief Returns the spatial reference of the array with axes mapped to the x and y dimensions
+        */
+        std::shared_ptr<OGRSpatialReference> GetSpatialRef() const override;
+    };
+
+    /**
+    * @brief Root group listing one array per attribute and the dimensions of a SciDB array
+    *
+    * Spatial dimensions of arrays without rotation get regularly spaced indexing variables with world coordinates of
+    * pixel centers.
+    */
+    class SciDBMDGroup : public GDALGroup {
+        std::vector<std::shared_ptr<GDALDimension> > _dims;
+        std::vector<std::shared_ptr<GDALMDArray> > _arrays;
+
+    public:
+        /**
+        * @brief Creates dimensions and arrays for all attributes of the context's array
+        *
+        * @param ctx shared context of the dataset
+        */
+        explicit SciDBMDGroup(const std::shared_ptr<SciDBMultiDimContext>& ctx);
+
+        std::vector<std::string> GetMDArrayNames(CSLConstList papszOptions = nullptr) const override;
+
+        std::shared_ptr<GDALMDArray> OpenMDArray(const std::string& osName, CSLConstList papszOptions = nullptr) const override;
+
+        std::vector<std::shared_ptr<GDALDimension> > GetDimensions(CSLConstList papszOptions = nullptr) const override {
+            return _dims;
+        }
+    };
+
+    /**
+    * @brief Dataset opened with GDAL_OF_MULTIDIM_RASTER, only offering the root group
+    */
+    class SciDBMultiDimDataset : public GDALDataset {
+        std::shared_ptr<SciDBMDGroup> _rootGroup;
+
+    public:
+        /**
+        * @brief Creates the root group, the dataset takes ownership of the array metadata and the client
+        *
+        * @param array metadata of an existing array
+        * @param client client connected to the database
+        * @param materializedArray temporary array holding a materialized query result, empty if not owned
+        */
+        SciDBMultiDimDataset(SciDBSpatialArray* array, ShimClient* client, const string& materializedArray);
+
+        std::shared_ptr<GDALGroup> GetRootGroup() const override { return _rootGroup; }
+    };
+}
+
+#endif
+
+#endif
@@ -39,7 +39,9 @@ namespace scidb4gdal {
         /** bool value whether SSL certificates should be checked or not */
         SSLTRUST, 
         /** the key to confirm the delete process */
-        CONFIRM_DELETE
+        CONFIRM_DELETE,
+        /** the key for an AFL query whose result is opened instead of a stored array */
+        QUERY
     };
 
     /**
@@ -54,7 +56,19 @@ namespace scidb4gdal {
         BBOX,
         SRS,
         CHUNKSIZE_SPATIAL,
-        CHUNKSIZE_TEMPORAL
+        CHUNKSIZE_TEMPORAL,
+        REDUCER,
+        APPLY,
+        FILTER,
+        OCCUPANCY,
+        VERSION,
+        MASK,
+        ALIGN,
+        BLOCKSIZE,
+        REQUEST_MB,
+        CACHE_MB,
+        CACHE_MODE,
+        WARM_CACHE
     };
 
     /**
@@ -105,6 +119,8 @@ namespace scidb4gdal {
         int chunksize_spatial;
         /** the blocksize for the temporal dimension */
         int chunksize_temporal;
+        /** whether or not the returned dataset's tile cache is filled from the source image */
+        bool warmCache;
 
         CreationParameters() { _init(); }
 
@@ -116,6 +132,7 @@ namespace scidb4gdal {
         void _init() {
             chunksize_spatial = -1;
             chunksize_temporal = -1;
+            warmCache = false;
             timestamp = "";
             dt = "";
             hasBBOX = false;
@@ -154,19 +171,50 @@ namespace scidb4gdal {
     */
     struct QueryParameters : Parameters {
         /** the temporal index of an temporally referenced array */
-        int temp_index;
-        /** the lower bound of an interval query (currently not implemented) */
-        int lower_bound;
-        /** the upper bound of an interval query (currently not implemented) */
-        int upper_bound;
+        int64_t temp_index;
+        /** the lower bound of an interval query */
+        int64_t lower_bound;
+        /** the upper bound of an interval query */
+        int64_t upper_bound;
         /** the dimension name pf the temporal axis */
         string dim_name;
-        /** the ISO 8601 data/time string to query for */
+        /** the ISO 8601 data/time string to query for, or the start of an interval query */
         string timestamp;
+        /** the ISO 8601 data/time string of the end of an interval query */
+        string timestamp_end;
         /** flag whether or not the temporal index was set */
         bool hasTemporalIndex;
+        /** flag whether or not a temporal interval was requested, each temporal index will be represented as separate bands */
+        bool hasTemporalRange;
+        /** name of the aggregation function (min, max, mean, median, latest) to composite the temporal interval server-side, empty if not used */
+        string reducer;
+        /** names of attributes derived with apply(), only these are exposed as bands if not empty */
+        vector<string> apply_names;
+        /** AFL expressions of the derived attributes, same order as apply_names */
+        vector<string> apply_exprs;
+        /** AFL filter expression applied to the array before reading, empty if not used */
+        string filter;
+        /** flag whether or not empty blocks are detected in advance and answered without querying their data */
+        bool useOccupancy;
+        /** the array version to be read, -1 for the most recent version at opening time */
+        int64_t version;
+        /** flag whether or not empty cells are reported by a per-dataset mask band */
+        bool useMask;
+        /** flag whether or not the image is padded such that blocks coincide with the array's spatial chunks */
+        bool alignBlocks;
+        /** requested block size in cells, rounded to a multiple or divisor of the chunk size, -1 to derive it from request_mb */
+        int blockSize;
+        /** targeted size of a block in megabytes if the block size is derived automatically */
+        double requestMB;
+        /** size of the process-wide tile cache in megabytes, -1 to keep the current size */
+        double cacheMB;
+        /** where downloaded blocks are cached, SHARED for the driver's process-wide cache or GDAL for GDAL's block cache only, empty for the default */
+        string cacheMode;
 
-        QueryParameters() : temp_index(-1), hasTemporalIndex(false) {}
+        QueryParameters()
+            : temp_index(-1), lower_bound(-1), upper_bound(-1), hasTemporalIndex(false), hasTemporalRange(false), useOccupancy(true),
+              version(-1), useMask(false), alignBlocks(false), blockSize(-1), requestMB(SCIDB4GDAL_DEFAULT_REQUEST_MB),
+              cacheMB(-1) {}
     };
 
     /**
@@ -180,6 +228,10 @@ namespace scidb4gdal {
     struct ConnectionParameters : Parameters {
         /** the array name */
         string arrayname;
+        /** AFL query to be materialized and opened instead of a stored array, empty if not used */
+        string query;
+        /** further arrays on the same grid whose attributes are joined to the array as additional bands */
+        vector<string> joinarrays;
         /** the url of the host */
         string host;
         /** the server port */
@@ -203,7 +255,7 @@ namespace scidb4gdal {
         * Default constructor to create empty connection parameters
         */
         ConnectionParameters()
-            : arrayname(""), host(""), port(0), user(""), passwd(""), ssl(false), ssltrust(true),  deleteArray(false) {}
+            : arrayname(""), query(""), host(""), port(0), user(""), passwd(""), ssl(false), ssltrust(true),  deleteArray(false) {}
 
         /**
         * @brief Represents the connection parameter in string form
@@ -217,13 +269,18 @@ namespace scidb4gdal {
             stringstream pw_enc;
             // Do NOT print the password
             for (unsigned int i = 0; i<passwd.length(); ++i) pw_enc << "x";
-            s << "array=" << arrayname << " host=" << host << " port=" << port << " user=" << user << " passwd=" << pw_enc.str() <<  " ssl=" <<  (ssl ? "true" : "false") <<  " trust=" <<  (ssltrust  ?  "true" : "false");
+            if (!query.empty())
+                s << "query=" << query << " ";
+            s << "array=" << arrayname;
+            for (size_t i = 0; i < joinarrays.size(); ++i)
+                s << "," << joinarrays[i];
+            s << " host=" << host << " port=" << port << " user=" << user << " passwd=" << pw_enc.str() <<  " ssl=" <<  (ssl ? "true" : "false") <<  " trust=" <<  (ssltrust  ?  "true" : "false");
             return s.str();
         };
 
         bool isValid() {
             bool valid = true;
-            if (arrayname == "" || host == "") {
+            if ((arrayname == "" && query == "") || host == "") {
                 error_code = ERR_READ_ARRAYUNKNOWN;
                 valid = false;
             }
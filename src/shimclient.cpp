@@ -29,12 +29,14 @@ SOFTWARE.
 #include "TemporalReference.h"
 #include <iomanip>
 #include <limits>
+#include <algorithm>
+#include <ctime>
 
 namespace scidb4gdal {
     using namespace scidb4geo;
 
     ShimClient::ShimClient()
-        : _host("https://localhost"), _port(8083), _user("scidb"), _passwd("scidb"), _ssl(true), _curl_handle(0), _curl_initialized(false), _auth(""),  _hasSCIDB4GEO(NULL), _shimversion("") {
+        : _host("https://localhost"), _port(8083), _user("scidb"), _passwd("scidb"), _ssl(true), _curl_handle(0), _curl_initialized(false), _auth(""), _cp(NULL), _qp(NULL), _hasSCIDB4GEO(NULL), _shimversion("") {
         curl_global_init(CURL_GLOBAL_ALL);
         stringstream ss;
 
@@ -56,7 +58,7 @@ namespace scidb4gdal {
 
     ShimClient::ShimClient(string host, uint16_t port, string user, string passwd,
                         bool ssl = false)
-        : _host(host), _port(port), _user(user), _passwd(passwd), _ssl(ssl), _curl_handle(0), _curl_initialized(false), _auth(""),  _hasSCIDB4GEO(NULL), _shimversion("") {
+        : _host(host), _port(port), _user(user), _passwd(passwd), _ssl(ssl), _curl_handle(0), _curl_initialized(false), _auth(""), _cp(NULL), _qp(NULL), _hasSCIDB4GEO(NULL), _shimversion("") {
         curl_global_init(CURL_GLOBAL_ALL);
         stringstream ss;
 
@@ -87,6 +89,8 @@ namespace scidb4gdal {
         _curl_handle(0),
         _curl_initialized(false),
         _auth(""), 
+        _cp(NULL),
+        _qp(NULL),
         _hasSCIDB4GEO(NULL),
         _shimversion(""){
         
@@ -132,6 +136,16 @@ namespace scidb4gdal {
         return size * count;
     }
 
+    /**
+    * Callback function for receiving scidb binary data of unknown size, in contrast to
+    * responseToStringCallback, the data may contain null bytes
+    */
+    static size_t responseToBinaryStringCallback(void* ptr, size_t size, size_t count,
+                                        void* stream) {
+        ((string*)stream)->append((char*)ptr, size * count);
+        return size * count;
+    }
+
     /**
     * Callback function for receiving scidb binary data
     */
@@ -438,6 +452,147 @@ namespace scidb4gdal {
         curlEnd();
     }
 
+    string ShimClient::getNoDataString(SciDBSpatialArray& array, uint8_t nband, bool stored) {
+        MD md = array.attrs[nband].md[""];
+        if (md.find(SCIDB4GDAL_DEFAULTMDFIELD_NODATA) == md.end()) {
+            const SciDBAttribute& attr = array.attrs[nband];
+            stringstream dtos;
+            dtos << Utils::defaultNoDataSciDB((stored && !attr.sourceTypeId.empty()) ? attr.sourceTypeId : attr.typeId);
+            return dtos.str();
+        }
+        return md[SCIDB4GDAL_DEFAULTMDFIELD_NODATA];
+    }
+
+    string ShimClient::getValidCondition(const string& attrname, const string& naval) {
+        // NaN cannot be compared
+        if (boost::algorithm::iends_with(naval, "nan"))
+            return "not is_nan(" + attrname + ")";
+        return attrname + "<>" + naval;
+    }
+
+    string ShimClient::getSourceExpression(SciDBSpatialArray& array) {
+        string expr = array.name;
+        if (array.version > 0)
+            expr += "@" + boost::lexical_cast<string>(array.version);
+        for (size_t i = 0; i < array.joins.size(); ++i) {
+            expr = "join(" + expr + "," + array.joins[i] + ")";
+        }
+        return expr;
+    }
+
+    string ShimClient::getInputExpression(SciDBSpatialArray& array) {
+        string expr = getSourceExpression(array);
+        if (!_qp)
+            return expr;
+        if (!_qp->filter.empty()) {
+            expr = "filter(" + expr + "," + _qp->filter + ")";
+        }
+        if (!_qp->apply_names.empty()) {
+            stringstream s;
+            s << "apply(" << expr;
+            for (size_t i = 0; i < _qp->apply_names.size(); ++i) {
+                s << "," << _qp->apply_names[i] << "," << _qp->apply_exprs[i];
+            }
+            s << ")";
+            expr = s.str();
+        }
+        return expr;
+    }
+
+    StatusCode ShimClient::queryBinary(int sessionID, const string& afl, const string& format, string& out) {
+        Utils::debug("Performing AFL Query: " + afl);
+
+        {
+            curlBegin();
+            stringstream ss;
+            // EXECUTE QUERY  ////////////////////////////
+            ss << _host << SHIMENDPOINT_EXECUTEQUERY << "?"
+            << "id=" << sessionID << "&query=" << curl_easy_escape(_curl_handle, afl.c_str(), 0)
+            << "&save=" << curl_easy_escape(_curl_handle, format.c_str(), 0);
+            // Add auth parameter if using ssl
+            if (_ssl && !_auth.empty())
+                ss << "&auth=" << _auth;
+            curl_easy_setopt(_curl_handle, CURLOPT_URL, ss.str().c_str());
+            curl_easy_setopt(_curl_handle, CURLOPT_HTTPGET, 1);
+            string response;
+            curl_easy_setopt(_curl_handle, CURLOPT_WRITEFUNCTION, &responseToStringCallback);
+            curl_easy_setopt(_curl_handle, CURLOPT_WRITEDATA, &response);
+            if (curlPerform() != CURLE_OK) {
+                curlEnd();
+                return ERR_GLOBAL_UNKNOWN;
+            }
+            curlEnd();
+        }
+
+        {
+            curlBegin();
+            stringstream ss;
+            // READ BYTES  ////////////////////////////
+            ss << _host << SHIMENDPOINT_READ_BYTES << "?"
+            << "id=" << sessionID << "&n=0";
+            // Add auth parameter if using ssl
+            if (_ssl && !_auth.empty())
+                ss << "&auth=" << _auth;
+            curl_easy_setopt(_curl_handle, CURLOPT_URL, ss.str().c_str());
+            curl_easy_setopt(_curl_handle, CURLOPT_HTTPGET, 1);
+            out = "";
+            curl_easy_setopt(_curl_handle, CURLOPT_WRITEFUNCTION, &responseToBinaryStringCallback);
+            curl_easy_setopt(_curl_handle, CURLOPT_WRITEDATA, &out);
+            if (curlPerform() != CURLE_OK) {
+                curlEnd();
+                return ERR_GLOBAL_UNKNOWN;
+            }
+            curlEnd();
+        }
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::executeQuery(int sessionID, const string& afl) {
+        Utils::debug("Performing AFL Query: " + afl);
+
+        curlBegin();
+        stringstream ss;
+        // EXECUTE QUERY  ////////////////////////////
+        ss << _host << SHIMENDPOINT_EXECUTEQUERY << "?"
+        << "id=" << sessionID << "&query=" << curl_easy_escape(_curl_handle, afl.c_str(), 0);
+        // Add auth parameter if using ssl
+        if (_ssl && !_auth.empty())
+            ss << "&auth=" << _auth;
+        curl_easy_setopt(_curl_handle, CURLOPT_URL, ss.str().c_str());
+        curl_easy_setopt(_curl_handle, CURLOPT_HTTPGET, 1);
+        string response;
+        curl_easy_setopt(_curl_handle, CURLOPT_WRITEFUNCTION, &responseToStringCallback);
+        curl_easy_setopt(_curl_handle, CURLOPT_WRITEDATA, &response);
+        if (curlPerform() != CURLE_OK) {
+            curlEnd();
+            return ERR_GLOBAL_UNKNOWN;
+        }
+        curlEnd();
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getQuerySchema(const string& afl, string& schema) {
+        string q = afl;
+        boost::algorithm::replace_all(q, "'", "\\'");
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, "show('" + q + "','afl')", "tsv", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        // the result looks like name<a:int16> [x=0:99,100,0], the array name is omitted
+        size_t start = response.find('<');
+        size_t end = response.find_last_of(']');
+        if (start == string::npos || end == string::npos || end < start) {
+            Utils::debug("Invalid response of show(): " + response);
+            return ERR_GLOBAL_PARSE;
+        }
+        schema = response.substr(start, end - start + 1);
+        return SUCCESS;
+    }
+
     void ShimClient::login() {
         
         /* Since the login endpoint as been removed with SciDB 15.12 we need
@@ -1017,6 +1172,252 @@ namespace scidb4gdal {
         return SUCCESS;
     }
 
+    StatusCode ShimClient::getDerivedAttributeDesc(const string& inArrayName, vector<SciDBAttribute>& out) {
+        if (!_qp || _qp->apply_names.empty())
+            return SUCCESS;
+
+        stringstream apply;
+        apply << "apply(" << inArrayName;
+        for (size_t i = 0; i < _qp->apply_names.size(); ++i) {
+            apply << "," << _qp->apply_names[i] << "," << _qp->apply_exprs[i];
+        }
+        apply << ")";
+
+        string response;
+        StatusCode res = getQuerySchema(apply.str(), response);
+        if (res != SUCCESS) {
+            Utils::error("Cannot derive schema of apply expressions");
+            return res;
+        }
+
+        // the schema looks like <a:int16,b:double NULL DEFAULT null> [x=...]
+        size_t end = response.find('>');
+        if (end == string::npos) {
+            Utils::error("Cannot derive schema of apply expressions: " + response);
+            return ERR_GLOBAL_PARSE;
+        }
+        vector<string> parts;
+        string attrstr = response.substr(1, end - 1);
+        boost::split(parts, attrstr, boost::is_any_of(","));
+
+        vector<SciDBAttribute> derived;
+        for (size_t i = 0; i < _qp->apply_names.size(); ++i) {
+            bool found = false;
+            for (size_t j = 0; j < parts.size(); ++j) {
+                size_t pos = parts[j].find(':');
+                if (pos == string::npos)
+                    continue;
+                if (boost::algorithm::trim_copy(parts[j].substr(0, pos)) != _qp->apply_names[i])
+                    continue;
+
+                string def = boost::algorithm::to_upper_copy(parts[j].substr(pos + 1));
+                size_t dpos = def.find("DEFAULT");
+                if (dpos != string::npos)
+                    def = def.substr(0, dpos);
+                vector<string> tokens;
+                string typestr = boost::algorithm::trim_copy(parts[j].substr(pos + 1));
+                boost::split(tokens, typestr, boost::is_any_of(" "));
+
+                SciDBAttribute attr;
+                attr.name = _qp->apply_names[i];
+                attr.typeId = tokens[0];
+                attr.nullable = (def.find("NULL") != string::npos && def.find("NOT NULL") == string::npos);
+                if (Utils::scidbTypeIdToGDALType(attr.typeId) == GDT_Unknown) {
+                    Utils::error("SciDB GDAL driver does not support data type " + attr.typeId + " of derived attribute '" +
+                                 attr.name + "'");
+                    return ERR_GLOBAL_UNKNOWN;
+                }
+                derived.push_back(attr);
+                found = true;
+                break;
+            }
+            if (!found) {
+                Utils::error("Derived attribute '" + _qp->apply_names[i] + "' not found in schema " + response);
+                return ERR_GLOBAL_PARSE;
+            }
+        }
+
+        out = derived;
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getArrayVersion(const string& inArrayName, int64_t& out) {
+        out = 0;
+        stringstream afl;
+        afl << "aggregate(versions(" << inArrayName << "),max(version_id) as v)";
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "tsv", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS) {
+            Utils::warn("Cannot fetch version of array '" + inArrayName + "'");
+            return res;
+        }
+
+        boost::algorithm::trim(response);
+        try {
+            // empty aggregates yield null, e.g. for temporary arrays
+            if (!response.empty() && response != "\\N" && response != "null")
+                out = boost::lexical_cast<int64_t>(response);
+        } catch (boost::bad_lexical_cast e) {
+            Utils::warn("Cannot interpret version of array '" + inArrayName + "': " + response);
+            return ERR_GLOBAL_PARSE;
+        }
+        return SUCCESS;
+    }
+
+    map<string, int> ShimClient::_materialized;
+    CPLMutex* ShimClient::_materializedMutex = NULL;
+    string ShimClient::_processToken;
+
+    StatusCode ShimClient::getArrayIds(map<string, pair<int64_t, int64_t> >& out) {
+        out.clear();
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, "project(list('arrays'),name,uaid,aid)", "tsv", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS) {
+            Utils::warn("Cannot fetch array ids");
+            return res;
+        }
+
+        vector<string> lines;
+        boost::split(lines, response, boost::is_any_of("\n"), boost::token_compress_on);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            vector<string> fields;
+            boost::split(fields, lines[i], boost::is_any_of("\t"));
+            if (fields.size() != 3)
+                continue;
+            try {
+                string name = boost::algorithm::trim_copy_if(fields[0], boost::is_any_of("'\""));
+                out[name] = pair<int64_t, int64_t>(boost::lexical_cast<int64_t>(boost::algorithm::trim_copy(fields[1])),
+                                                   boost::lexical_cast<int64_t>(boost::algorithm::trim_copy(fields[2])));
+            } catch (boost::bad_lexical_cast e) {
+                Utils::debug("Cannot interpret array ids: " + lines[i]);
+            }
+        }
+        return SUCCESS;
+    }
+
+    string ShimClient::getReferencedArrayIds(const string& expr, const map<string, pair<int64_t, int64_t> >& ids,
+                                             bool versioned) {
+        stringstream out;
+        string token;
+        for (size_t i = 0; i <= expr.size(); ++i) {
+            char c = (i < expr.size()) ? expr[i] : ' ';
+            if (isalnum((unsigned char)c) || c == '_') {
+                token += c;
+                continue;
+            }
+            map<string, pair<int64_t, int64_t> >::const_iterator it = ids.find(token);
+            if (it != ids.end())
+                out << "|" << token << ":" << (versioned ? it->second.second : it->second.first);
+            token.clear();
+        }
+        return out.str();
+    }
+
+    StatusCode ShimClient::materializeQuery(const string& query, string& arrayname) {
+        // the result depends on the current versions of all arrays the query refers to
+        stringstream key;
+        key << _host << "|" << query;
+        map<string, pair<int64_t, int64_t> > ids;
+        if (getArrayIds(ids) == SUCCESS)
+            key << getReferencedArrayIds(query, ids, true);
+
+        // creating under the lock lets concurrent datasets of the same query wait for one result
+        CPLMutexHolderD(&_materializedMutex);
+        if (_processToken.empty()) {
+            // process ids repeat across hosts and over time, CPLGetPID() only identifies the calling thread
+            char host[256] = "";
+            gethostname(host, sizeof(host) - 1);
+            stringstream token;
+#ifdef WIN32
+            token << host << "|" << GetCurrentProcessId();
+#else
+            token << host << "|" << getpid();
+#endif
+            token << "|" << time(NULL) << "|" << clock() << "|" << (void*)&token;
+            _processToken = Utils::hashString(token.str());
+        }
+        arrayname = SCIDB4GDAL_ARRAYPREFIX_QUERY + Utils::hashString(key.str()) + "_" + _processToken;
+        map<string, int>::iterator used = _materialized.find(arrayname);
+        if (used != _materialized.end()) {
+            Utils::debug("Reusing materialized query result '" + arrayname + "'");
+            ++used->second;
+            return SUCCESS;
+        }
+
+        // the name is unique to this process, an existing array belongs to someone else and must not be touched
+        bool exists = false;
+        if (arrayExists(arrayname, exists) != SUCCESS || exists) {
+            Utils::error("Cannot materialize query '" + query + "', temporary array '" + arrayname + "' is not available");
+            return ERR_CREATE_TEMPARRAY;
+        }
+
+        string schema;
+        StatusCode res = getQuerySchema(query, schema);
+        if (res != SUCCESS) {
+            Utils::error("Cannot derive schema of query '" + query + "'");
+            return res;
+        }
+
+        int sessionID = newSession();
+        res = executeQuery(sessionID, "CREATE TEMP ARRAY " + arrayname + " " + schema);
+        if (res == SUCCESS)
+            res = executeQuery(sessionID, "store(" + query + "," + arrayname + ")");
+        releaseSession(sessionID);
+
+        arrayExists(arrayname, exists);
+        if (res != SUCCESS || !exists) {
+            Utils::error("Cannot materialize query '" + query + "'");
+            if (exists)
+                removeArray(arrayname);
+            return ERR_CREATE_TEMPARRAY;
+        }
+        _materialized[arrayname] = 1;
+        return SUCCESS;
+    }
+
+    void ShimClient::releaseMaterializedQuery(const string& arrayname) {
+        CPLMutexHolderD(&_materializedMutex);
+        map<string, int>::iterator it = _materialized.find(arrayname);
+        if (it == _materialized.end() || --it->second > 0)
+            return;
+        _materialized.erase(it);
+        removeArray(arrayname);
+    }
+
+    StatusCode ShimClient::joinArray(SciDBSpatialArray& array, SciDBSpatialArray& other) {
+        int64_t version = 0;
+        if (getArrayVersion(other.name, version) != SUCCESS)
+            return ERR_READ_UNKNOWN;
+        string expr = other.name;
+        if (version > 0)
+            expr += "@" + boost::lexical_cast<string>(version);
+
+        // attribute names of join() results must be unique
+        bool renamed = false;
+        for (uint32_t i = 0; i < other.attrs.size(); ++i) {
+            for (uint32_t j = 0; j < array.attrs.size(); ++j) {
+                if (array.attrs[j].name == other.attrs[i].name) {
+                    other.attrs[i].name = other.name + "_" + other.attrs[i].name;
+                    renamed = true;
+                    break;
+                }
+            }
+        }
+        if (renamed) {
+            expr = "cast(" + expr + "," + other.getSchemaString() + ")";
+        }
+
+        array.attrs.insert(array.attrs.end(), other.attrs.begin(), other.attrs.end());
+        array.joins.push_back(expr);
+        Utils::debug("Joining array '" + other.name + "' as " + expr);
+        return SUCCESS;
+    }
+
     StatusCode ShimClient::getType(const string& name, SciDBSpatialArray*& array) {
        
 
@@ -1095,6 +1496,15 @@ namespace scidb4gdal {
         else csv = new CSVstring( response,false); // without header  
         
         
+        if (csv->nrow() == 0)
+        {
+            // arrays without spatial reference, e.g. materialized query results
+            delete csv;
+            releaseSession(sessionID);
+            array = new SciDBSpatialArray();
+            return SUCCESS;
+        }
+
         if (csv->nrow() != 1 || csv->ncol() < 1) 
         {
             delete csv;
@@ -1121,10 +1531,9 @@ namespace scidb4gdal {
     }
 
     StatusCode ShimClient::getData(SciDBSpatialArray& array, uint8_t nband,
-                                void* outchunk, int32_t x_min, int32_t y_min,
-                                int32_t x_max, int32_t y_max, bool use_subarray,
-                                bool emptycheck) {
-        int t_index;
+                                void* outchunk, int64_t x_min, int64_t y_min,
+                                int64_t x_max, int64_t y_max, bool use_subarray,
+                                bool emptycheck, const string& castType) {
         if (x_min < array.getXDim()->low || x_min > array.getXDim()->high ||
             x_max < array.getXDim()->low || x_max > array.getXDim()->high ||
             y_min < array.getYDim()->low || y_min > array.getYDim()->high ||
@@ -1135,165 +1544,132 @@ namespace scidb4gdal {
         if (nband >= array.attrs.size())
             Utils::error("Requested array band does not exist");
 
-        int8_t x_idx = array.getXDimIdx();
-        int8_t y_idx = array.getYDimIdx();
-
-        stringstream ss;
-        string response;
-        
-        
-        
-        MD md = array.attrs[nband].md[""];
-        string naval;
-        if (md.find(SCIDB4GDAL_DEFAULTMDFIELD_NODATA) == md.end())
-        {
-            stringstream dtos;
-            dtos <<  Utils::defaultNoDataSciDB(array.attrs[nband].typeId);
-            naval = dtos.str();
-        }
-        else naval =  md[SCIDB4GDAL_DEFAULTMDFIELD_NODATA];
-
-  
-        
-
-        int sessionID = newSession();
-
-        /* Depending on dimension ordering, array must be transposed. */
-
-        curlBegin();
-        // EXECUTE QUERY  ////////////////////////////
-        ss.str();
-        ss << _host << SHIMENDPOINT_EXECUTEQUERY << "?"  << "id=" << sessionID;
-
-        stringstream tslice;
-        if (SciDBSpatioTemporalArray* starray =
-                dynamic_cast<SciDBSpatioTemporalArray*>(&array)) {
-            // if we have a temporal index, we need to slice the data set
-            if (_qp) {
-                t_index = _qp->temp_index;
-            } else if (_cp) {
-                TPoint temp_point = TPoint(_cp->timestamp);
-                t_index = starray->indexAtDatetime(temp_point);
-            } else {
-                // TODO throw error
-                t_index = 0;
-                Utils::debug("Neither query nor creation parameter were found.");
+        stringstream afl;
+        afl << getDataExpression(array, vector<uint8_t>(1, nband), x_min, y_min, x_max, y_max, use_subarray, emptycheck);
+
+        // Narrower output types are converted server-side like GDALCopyWords() does, i.e. rounded and clamped
+        string saveType = array.attrs[nband].typeId;
+        if (!castType.empty()) {
+            double lo = 0, hi = 255;
+            if (castType == "int16") {
+                lo = -32768;
+                hi = 32767;
+            } else if (castType == "uint16") {
+                hi = 65535;
             }
-
-            tslice << "slice(" << array.name << "," + starray->tdim + "," << t_index
-                << ")";
-        } else {
-            // Utils::debug("Cast failed. Skipping the slicing.");
-            tslice << array.name;
+            string afl_temp = afl.str();
+            afl.str("");
+            afl << std::setprecision(numeric_limits<double>::digits10);
+            afl << "project(apply(apply(" << afl_temp << ",scidb4gdal_v,round(double(" << array.attrs[nband].name
+                << "))),scidb4gdal_c," << castType
+                << "(iif(is_nan(scidb4gdal_v),double(0),iif(scidb4gdal_v<" << lo << ",double(" << lo
+                << "),iif(scidb4gdal_v>" << hi << ",double(" << hi << "),scidb4gdal_v))))),scidb4gdal_c)";
+            saveType = castType;
         }
 
-        string arr = tslice.str();
-
-        stringstream afl;
-        if (x_idx > y_idx) { // TODO: need to check performance of differend ordering
-
-            if (use_subarray) {
-                if (emptycheck) {
-                    afl << "(merge(";
-                    afl << "project(subarray(" << arr << "," << y_min << "," << x_min << ","
-                        << y_max << "," << x_max << ")," << array.attrs[nband].name << ")";
-                    afl << ",build(<" << array.attrs[nband].name << ":"
-                        << array.attrs[nband].typeId << ((array.attrs[nband].nullable) ? " NULL" : " NOT NULL")
-                        << "> [" << array.getYDim()->name
-                        << "=" << 0 << ":" << y_max - y_min << ","
-                        << array.getYDim()->chunksize << "," << 0 << ","
-                        << array.getXDim()->name << "=" << 0 << ":" << x_max - x_min << ","
-                        << array.getXDim()->chunksize << "," << 0 << "],"
-                        << naval << ")))";
-                } else {
-                    afl << "(project(subarray(" << arr << "," << y_min << "," << x_min
-                        << "," << y_max << "," << x_max << ")," << array.attrs[nband].name
-                        << "))";
-                }
-            } else { // Between
-                // TODO: Test which way is the fastest
-                if (emptycheck) {
-                    afl << "(merge(";
-                    afl << "project(between(" << arr << "," << y_min << "," << x_min << ","
-                        << y_max << "," << x_max << ")," << array.attrs[nband].name << ")";
-                    afl << ",between(build(<" << array.attrs[nband].name << ":"
-                        << array.attrs[nband].typeId << ((array.attrs[nband].nullable) ? " NULL" : " NOT NULL")
-                        << "> [" << array.getYDim()->name
-                        << "=" << array.getYDim()->start << ":"
-                        << array.getYDim()->start + array.getYDim()->length - 1 << ","
-                        << array.getYDim()->chunksize << "," << 0 << ","
-                        << array.getXDim()->name << "=" << array.getXDim()->start << ":"
-                        << array.getXDim()->start + array.getXDim()->length - 1 << ","
-                        << array.getXDim()->chunksize << "," << 0 << "]," << naval << "),"
-                        << y_min << "," << x_min << "," << y_max << "," << x_max << ")))";
-                }
+        return readBinary(afl.str(), "(" + saveType + ")", outchunk);
+    }
 
-                else {
-                    afl << "(project(between(" << arr << "," << y_min << "," << x_min << ","
-                        << y_max << "," << x_max << ")," << array.attrs[nband].name << "))";
-                }
+    StatusCode ShimClient::getAttributesData(SciDBSpatialArray& array, const vector<uint8_t>& nbands, void* outchunk,
+                                             int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max) {
+        if (x_min < array.getXDim()->low || x_max > array.getXDim()->high || x_min > x_max ||
+            y_min < array.getYDim()->low || y_max > array.getYDim()->high || y_min > y_max) {
+            Utils::error("Requested array subset is outside array boundaries");
+            return ERR_READ_WRONGDIMENSIONALITY;
+        }
+        stringstream save;
+        save << "(";
+        for (size_t i = 0; i < nbands.size(); ++i) {
+            if (nbands[i] >= array.attrs.size()) {
+                Utils::error("Requested array band does not exist");
+                return ERR_READ_UNKNOWN;
             }
+            save << ((i > 0) ? "," : "") << array.attrs[nbands[i]].typeId;
         }
+        save << ")";
+        return readBinary(getDataExpression(array, nbands, x_min, y_min, x_max, y_max, true, true), save.str(), outchunk);
+    }
 
-        else {
+    string ShimClient::getDataExpression(SciDBSpatialArray& array, const vector<uint8_t>& nbands, int64_t x_min,
+                                         int64_t y_min, int64_t x_max, int64_t y_max, bool use_subarray,
+                                         bool emptycheck) {
+        /* Depending on dimension ordering, array must be transposed. */
+        bool transposed = array.getXDimIdx() < array.getYDimIdx(); // TODO: need to check performance of differend ordering
+        SciDBDimension* d0 = transposed ? array.getXDim() : array.getYDim();
+        SciDBDimension* d1 = transposed ? array.getYDim() : array.getXDim();
+        int64_t min0 = transposed ? x_min : y_min, max0 = transposed ? x_max : y_max;
+        int64_t min1 = transposed ? y_min : x_min, max1 = transposed ? y_max : x_max;
+
+        string arr = getSliceExpression(array, nbands[0], x_min, y_min, x_max, y_max);
+
+        // empty cells are filled with the no data value of each attribute by merging with constant arrays
+        stringstream names, fill;
+        for (size_t i = 0; i < nbands.size(); ++i) {
+            SciDBAttribute& attr = array.attrs[nbands[i]];
+            names << "," << attr.name;
+
+            stringstream build;
+            build << "build(<" << attr.name << ":" << attr.typeId << (attr.nullable ? " NULL" : " NOT NULL") << "> [";
             if (use_subarray) {
-                if (emptycheck) {
-                    afl << "transpose(merge(";
-                    afl << "project(subarray(" << arr << "," << x_min << "," << y_min << ","
-                        << x_max << "," << y_max << ")," << array.attrs[nband].name << ")";
-                    afl << ",build(<" << array.attrs[nband].name << ":"
-                        << array.attrs[nband].typeId << ((array.attrs[nband].nullable) ? " NULL" : " NOT NULL")                
-                        << "> [" << array.getXDim()->name
-                        << "=" << 0 << ":" << x_max - x_min << ","
-                        << array.getXDim()->chunksize << "," << 0 << ","
-                        << array.getYDim()->name << "=" << 0 << ":" << y_max - y_min << ","
-                        << array.getYDim()->chunksize << "," << 0 << "],"
-                        << naval << ")))";
-                } else {
-                    afl << "transpose(project(subarray(" << arr << "," << x_min << ","
-                        << y_min << "," << x_max << "," << y_max << "),"
-                        << array.attrs[nband].name << "))";
-                }
+                build << d0->name << "=" << 0 << ":" << max0 - min0 << "," << d0->chunksize << "," << 0 << ","
+                      << d1->name << "=" << 0 << ":" << max1 - min1 << "," << d1->chunksize << "," << 0 << "],"
+                      << getNoDataString(array, nbands[i]) << ")";
             } else {
-                if (emptycheck) {
-                    afl << "transpose(merge(";
-                    afl << "project(between(" << arr << "," << x_min << "," << y_min << ","
-                        << x_max << "," << y_max << ")," << array.attrs[nband].name << ")";
-                    afl << ",between(build(<" << array.attrs[nband].name << ":"
-                        << array.attrs[nband].typeId << ((array.attrs[nband].nullable) ? " NULL" : " NOT NULL")
-                        << "> [" << array.getXDim()->name
-                        << "=" << array.getXDim()->start << ":"
-                        << array.getXDim()->start + array.getXDim()->length - 1 << ","
-                        << array.getXDim()->chunksize << "," << 0 << ","
-                        << array.getYDim()->name << "=" << array.getYDim()->start << ":"
-                        << array.getYDim()->start + array.getYDim()->length - 1 << ","
-                        << array.getYDim()->chunksize << "," << 0 << "]," << naval << "),"
-                        << x_min << "," << y_min << "," << x_max << "," << y_max << ")))";
-                } else {
-                    afl << "transpose(project(between(" << arr << "," << x_min << ","
-                        << y_min << "," << x_max << "," << y_max << "),"
-                        << array.attrs[nband].name << "))";
-                }
+                // TODO: Test which way is the fastest
+                build << d0->name << "=" << d0->start << ":" << d0->start + d0->length - 1 << "," << d0->chunksize
+                      << "," << 0 << "," << d1->name << "=" << d1->start << ":" << d1->start + d1->length - 1 << ","
+                      << d1->chunksize << "," << 0 << "]," << getNoDataString(array, nbands[i]) << ")";
+                string b = build.str();
+                build.str("");
+                build << "between(" << b << "," << min0 << "," << min1 << "," << max0 << "," << max1 << ")";
             }
+            string f = fill.str();
+            fill.str("");
+            if (i == 0)
+                fill << build.str();
+            else
+                fill << "join(" << f << "," << build.str() << ")";
         }
 
+        stringstream afl;
+        afl << (transposed ? "transpose(" : "(");
+        if (emptycheck)
+            afl << "merge(";
+        afl << "project(" << (use_subarray ? "subarray(" : "between(") << arr << "," << min0 << "," << min1 << ","
+            << max0 << "," << max1 << ")" << names.str() << ")";
+        if (emptycheck)
+            afl << "," << fill.str() << ")";
+        afl << ")";
+
         //  If attribute is nullable, apply substitute to fill null cells with default null value
-        if (array.attrs[nband].nullable) {
+        for (size_t i = 0; i < nbands.size(); ++i) {
+            SciDBAttribute& attr = array.attrs[nbands[i]];
+            if (!attr.nullable)
+                continue;
             string afl_temp = afl.str();
             afl.str("");
-            afl << "substitute(" <<  afl_temp <<  ", build(<val:" << array.attrs[nband].typeId <<  ">[i=0:0, 1, 0], " << naval  <<  "))";
-
+            afl << "substitute(" << afl_temp << ", build(<val:" << attr.typeId << ">[i=0:0, 1, 0], "
+                << getNoDataString(array, nbands[i]) << ")";
+            if (nbands.size() > 1)
+                afl << "," << attr.name;
+            afl << ")";
         }
-        
-        
-        
-        Utils::debug("Performing AFL Query: " + afl.str());
+        return afl.str();
+    }
+
+    StatusCode ShimClient::readBinary(const string& afl, const string& saveFormat, void* outchunk) {
+        stringstream ss;
+        string response;
+        int sessionID = newSession();
+
+        curlBegin();
+        // EXECUTE QUERY  ////////////////////////////
+        ss << _host << SHIMENDPOINT_EXECUTEQUERY << "?"  << "id=" << sessionID;
 
+        Utils::debug("Performing AFL Query: " + afl);
 
-        ss << "&query=" << curl_easy_escape(_curl_handle, afl.str().c_str(), 0)
-           << "&save=" << "(" << array.attrs[nband].typeId;
-        //if (array.attrs[nband].nullable) ss  << " " <<  "null";
-        ss << ")";
+        ss << "&query=" << curl_easy_escape(_curl_handle, afl.c_str(), 0)
+           << "&save=" << saveFormat;
         // Add auth parameter if using ssl
         if (_ssl && !_auth.empty())
             ss << "&auth=" << _auth;
@@ -1330,8 +1706,622 @@ namespace scidb4gdal {
 
         releaseSession(sessionID);
 
-        outchunk = (void*)data.memory;
+        return SUCCESS;
+    }
+
+    string ShimClient::getSliceExpression(SciDBSpatialArray& array, uint8_t nband, int64_t x_min, int64_t y_min,
+                                          int64_t x_max, int64_t y_max) {
+        int64_t t_index;
+        stringstream tslice;
+        if (SciDBSpatioTemporalArray* starray =
+                dynamic_cast<SciDBSpatioTemporalArray*>(&array)) {
+            if (_qp && !_qp->reducer.empty()) {
+                // temporal composites are reduced server-side to a two-dimensional array
+                tslice << getCompositeExpression(*starray, nband, x_min, y_min, x_max, y_max);
+            } else {
+                // if we have a temporal index, we need to slice the data set
+                if (_qp) {
+                    t_index = _qp->temp_index;
+                } else if (_cp) {
+                    TPoint temp_point = TPoint(_cp->timestamp);
+                    t_index = starray->indexAtDatetime(temp_point);
+                } else {
+                    // TODO throw error
+                    t_index = 0;
+                    Utils::debug("Neither query nor creation parameter were found.");
+                }
+
+                tslice << "slice(" << getInputExpression(array) << "," + starray->tdim + "," << t_index
+                    << ")";
+            }
+        } else {
+            // Utils::debug("Cast failed. Skipping the slicing.");
+            tslice << getInputExpression(array);
+        }
+
+        return tslice.str();
+    }
+
+    string ShimClient::getCompositeExpression(SciDBSpatioTemporalArray& array, uint8_t nband, int64_t x_min,
+                                              int64_t y_min, int64_t x_max, int64_t y_max) {
+        SciDBAttribute& attr = array.attrs[nband];
+        // input cells are compared in the stored type, mean and median only change the output type
+        string naval = getNoDataString(array, nband, true);
+        string xdim = array.getXDim()->name;
+        string ydim = array.getYDim()->name;
+        string tdim = array.getTDim()->name;
+
+        // between() boundaries in dimension order, spatial dimensions in array order for grouping
+        stringstream lower, upper, groups, schema;
+        schema << "<" << attr.name << ":" << attr.typeId << " NULL>[";
+        for (uint32_t i = 0; i < array.dims.size(); ++i) {
+            if (i > 0) {
+                lower << ",";
+                upper << ",";
+            }
+            if ((int)i == array.getXDimIdx() || (int)i == array.getYDimIdx()) {
+                bool isx = ((int)i == array.getXDimIdx());
+                lower << (isx ? x_min : y_min);
+                upper << (isx ? x_max : y_max);
+                if (!groups.str().empty()) {
+                    groups << ",";
+                    schema << ",";
+                }
+                groups << array.dims[i].name;
+                schema << array.dims[i].name << "=" << array.dims[i].low << ":" << array.dims[i].high << ","
+                       << array.dims[i].chunksize << ",0";
+            } else if ((int)i == array.getTDimIdx()) {
+                lower << _qp->lower_bound;
+                upper << _qp->upper_bound;
+            } else {
+                lower << array.dims[i].low;
+                upper << array.dims[i].low;
+            }
+        }
+        schema << "]";
+
+        stringstream input;
+        input << "filter(between(" << getInputExpression(array) << "," << lower.str() << "," << upper.str() << "),"
+              << getValidCondition(attr.name, naval) << ")";
+
+        stringstream afl;
+        if (_qp->reducer == "min" || _qp->reducer == "max") {
+            afl << "aggregate(" << input.str() << "," << _qp->reducer << "(" << attr.name << ") as " << attr.name << ","
+                << groups.str() << ")";
+        } else if (_qp->reducer == "mean") {
+            afl << "aggregate(" << input.str() << ",avg(" << attr.name << ") as " << attr.name << "," << groups.str() << ")";
+        } else if (_qp->reducer == "median") {
+            // quantile with two intervals yields minimum, median and maximum
+            afl << "project(apply(slice(quantile(" << input.str() << ",2," << attr.name << "," << groups.str() << "),quantile,1),"
+                << attr.name << ",double(" << attr.name << "_quantile))," << attr.name << ")";
+        } else if (_qp->reducer == "latest") {
+            // find the last valid temporal index per pixel and join it with the observations
+            afl << "redimension(project(filter(cross_join(" << input.str() << " as a,"
+                << "aggregate(apply(" << input.str() << ",scidb4gdal_t," << tdim << "),max(scidb4gdal_t) as scidb4gdal_tmax,"
+                << groups.str() << ") as m,"
+                << "a." << ydim << ",m." << ydim << ",a." << xdim << ",m." << xdim << "),"
+                << tdim << "=scidb4gdal_tmax)," << attr.name << ")," << schema.str() << ")";
+        } else {
+            Utils::error("Unknown reducer '" + _qp->reducer + "'");
+        }
+        return afl.str();
+    }
+
+    StatusCode ShimClient::getTimeSeries(SciDBSpatioTemporalArray& array, uint8_t nband, void* outchunk,
+                                         int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                                         int64_t t_min, int64_t t_max) {
+        if (x_min < array.getXDim()->low || x_max > array.getXDim()->high || x_min > x_max ||
+            y_min < array.getYDim()->low || y_max > array.getYDim()->high || y_min > y_max ||
+            t_min < array.getTDim()->low || t_max > array.getTDim()->high || t_min > t_max) {
+            Utils::error("Requested time series is outside array boundaries");
+            return ERR_READ_WRONGDIMENSIONALITY;
+        }
+        if (nband >= array.attrs.size()) {
+            Utils::error("Requested array band does not exist");
+            return ERR_READ_UNKNOWN;
+        }
+
+        SciDBAttribute& attr = array.attrs[nband];
+        string naval = getNoDataString(array, nband);
+
+        // between() needs boundaries in the order of the array's dimensions
+        stringstream lower, upper;
+        for (uint32_t i = 0; i < array.dims.size(); ++i) {
+            if (i > 0) {
+                lower << ",";
+                upper << ",";
+            }
+            if ((int)i == array.getXDimIdx()) {
+                lower << x_min;
+                upper << x_max;
+            } else if ((int)i == array.getYDimIdx()) {
+                lower << y_min;
+                upper << y_max;
+            } else if ((int)i == array.getTDimIdx()) {
+                lower << t_min;
+                upper << t_max;
+            } else {
+                lower << array.dims[i].low;
+                upper << array.dims[i].low;
+            }
+        }
+
+        // The result schema consists of a single chunk ordered by t, y, x
+        stringstream schema;
+        schema << "<" << attr.name << ":" << attr.typeId << (attr.nullable ? " NULL" : " NOT NULL") << ">"
+               << "[" << array.getTDim()->name << "=" << t_min << ":" << t_max << "," << 1 + t_max - t_min << ",0,"
+               << array.getYDim()->name << "=" << y_min << ":" << y_max << "," << 1 + y_max - y_min << ",0,"
+               << array.getXDim()->name << "=" << x_min << ":" << x_max << "," << 1 + x_max - x_min << ",0]";
+
+        stringstream afl;
+        afl << "merge(redimension(project(between(" << getInputExpression(array) << "," << lower.str() << "," << upper.str() << "),"
+            << attr.name << ")," << schema.str() << "),build(" << schema.str() << "," << naval << "))";
+
+        if (attr.nullable) {
+            string afl_temp = afl.str();
+            afl.str("");
+            afl << "substitute(" << afl_temp << ", build(<val:" << attr.typeId << ">[i=0:0, 1, 0], " << naval << "))";
+        }
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(" + attr.typeId + ")", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        size_t expected = (size_t)(1 + t_max - t_min) * (1 + y_max - y_min) * (1 + x_max - x_min) *
+                          Utils::scidbTypeIdBytes(attr.typeId);
+        if (response.size() != expected) {
+            stringstream s;
+            s << "Unexpected size of time series result: " << response.size() << " bytes instead of " << expected;
+            Utils::error(s.str());
+            return ERR_READ_UNKNOWN;
+        }
+        memcpy(outchunk, response.data(), expected);
+
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getPointValues(SciDBSpatialArray& array, uint8_t nband, const vector<int64_t>& cells, void* out) {
+        if (nband >= array.attrs.size()) {
+            Utils::error("Requested array band does not exist");
+            return ERR_READ_UNKNOWN;
+        }
+        size_t n = cells.size() / 2;
+        if (n == 0)
+            return SUCCESS;
+
+        SciDBAttribute& attr = array.attrs[nband];
+        string naval = getNoDataString(array, nband);
+        size_t nbytes = Utils::scidbTypeIdBytes(attr.typeId);
+        SciDBDimension* xdim = array.getXDim();
+        SciDBDimension* ydim = array.getYDim();
+
+        // fill with no data first, cells outside the array or without data are not part of the result
+        double nodata = CPLAtof(naval.c_str());
+        GDALCopyWords(&nodata, GDT_Float64, 0, out, Utils::scidbTypeIdToGDALType(attr.typeId), nbytes, n);
+
+        int64_t x_min = xdim->high, x_max = xdim->low, y_min = ydim->high, y_max = ydim->low;
+        vector<int64_t> upload;
+        upload.reserve(3 * n);
+        for (size_t i = 0; i < n; ++i) {
+            int64_t x = cells[2 * i], y = cells[2 * i + 1];
+            if (x < xdim->low || x > xdim->high || y < ydim->low || y > ydim->high)
+                continue;
+            upload.push_back(i);
+            upload.push_back(x);
+            upload.push_back(y);
+            x_min = std::min(x_min, x);
+            x_max = std::max(x_max, x);
+            y_min = std::min(y_min, y);
+            y_max = std::max(y_max, y);
+        }
+        size_t ninside = upload.size() / 3;
+        if (ninside == 0)
+            return SUCCESS;
+
+        int sessionID = newSession();
+        string remoteFilename;
+        if (uploadFile(sessionID, &upload[0], upload.size() * sizeof(int64_t), remoteFilename) != SUCCESS) {
+            releaseSession(sessionID);
+            Utils::error("Cannot upload point coordinates");
+            return ERR_GLOBAL_UNKNOWN;
+        }
+
+        // points are redimensioned to the chunking of the array's spatial dimensions as required by cross_join()
+        stringstream pschema, window;
+        pschema << "<scidb4gdal_i:int64>[";
+        if (array.getXDimIdx() > array.getYDimIdx()) {
+            pschema << "scidb4gdal_y=" << ydim->start << ":" << ydim->start + ydim->length - 1 << "," << ydim->chunksize << ",0,"
+                    << "scidb4gdal_x=" << xdim->start << ":" << xdim->start + xdim->length - 1 << "," << xdim->chunksize << ",0]";
+            window << y_min << "," << x_min << "," << y_max << "," << x_max;
+        } else {
+            pschema << "scidb4gdal_x=" << xdim->start << ":" << xdim->start + xdim->length - 1 << "," << xdim->chunksize << ",0,"
+                    << "scidb4gdal_y=" << ydim->start << ":" << ydim->start + ydim->length - 1 << "," << ydim->chunksize << ",0]";
+            window << x_min << "," << y_min << "," << x_max << "," << y_max;
+        }
+
+        stringstream points;
+        points << "redimension(input(<scidb4gdal_i:int64,scidb4gdal_x:int64,scidb4gdal_y:int64>[scidb4gdal_n=0:" << ninside - 1
+               << "," << ninside << ",0],'" << remoteFilename << "',-2,'(int64,int64,int64)')," << pschema.str() << ")";
+
+        stringstream afl;
+        afl << "project(cross_join(project(between(" << getSliceExpression(array, nband, x_min, y_min, x_max, y_max) << ","
+            << window.str() << ")," << attr.name << ") as a," << points.str() << " as p,"
+            << "a." << xdim->name << ",p.scidb4gdal_x,a." << ydim->name << ",p.scidb4gdal_y),scidb4gdal_i," << attr.name << ")";
+
+        if (attr.nullable) {
+            string afl_temp = afl.str();
+            afl.str("");
+            afl << "substitute(" << afl_temp << ", build(<val:" << attr.typeId << ">[i=0:0, 1, 0], " << naval << ")," << attr.name << ")";
+        }
+
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(int64," + attr.typeId + ")", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        // records consist of the point index followed by the value
+        size_t recordSize = sizeof(int64_t) + nbytes;
+        if (response.size() % recordSize != 0) {
+            Utils::error("Unexpected size of point query result");
+            return ERR_READ_UNKNOWN;
+        }
+        for (size_t r = 0; r < response.size() / recordSize; ++r) {
+            int64_t i;
+            memcpy(&i, &response[r * recordSize], sizeof(int64_t));
+            if (i < 0 || (size_t)i >= n)
+                continue;
+            memcpy(&((uint8_t*)out)[i * nbytes], &response[r * recordSize + sizeof(int64_t)], nbytes);
+        }
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getZonalStatistics(SciDBSpatialArray& array, uint8_t nband, const int32_t* zones, int32_t zoneNoData,
+                                              int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max, string& out) {
+        out = "";
+        if (nband >= array.attrs.size()) {
+            Utils::error("Requested array band does not exist");
+            return ERR_READ_UNKNOWN;
+        }
+        SciDBAttribute& attr = array.attrs[nband];
+        SciDBDimension* xdim = array.getXDim();
+        SciDBDimension* ydim = array.getYDim();
+        size_t nx = 1 + x_max - x_min;
+        size_t ny = 1 + y_max - y_min;
+        size_t n = nx * ny;
+
+        // the range of zone ids defines the single chunk of the result
+        int64_t z_min = 0, z_max = -1;
+        for (size_t i = 0; i < n; ++i) {
+            if (zones[i] == zoneNoData)
+                continue;
+            if (z_max < z_min) {
+                z_min = z_max = zones[i];
+            }
+            z_min = std::min(z_min, (int64_t)zones[i]);
+            z_max = std::max(z_max, (int64_t)zones[i]);
+        }
+        if (z_max < z_min)
+            return SUCCESS;
+
+        int sessionID = newSession();
+        string remoteFilename;
+        if (uploadFile(sessionID, (void*)zones, n * sizeof(int32_t), remoteFilename) != SUCCESS) {
+            releaseSession(sessionID);
+            Utils::error("Cannot upload zone raster");
+            return ERR_GLOBAL_UNKNOWN;
+        }
+
+        // zones are uploaded row by row as one-dimensional array and redimensioned to the chunking of the
+        // array's spatial dimensions as required by cross_join()
+        stringstream zschema, window;
+        zschema << "<scidb4gdal_zone:int64>[";
+        if (array.getXDimIdx() > array.getYDimIdx()) {
+            zschema << "scidb4gdal_y=" << ydim->start << ":" << ydim->start + ydim->length - 1 << "," << ydim->chunksize << ",0,"
+                    << "scidb4gdal_x=" << xdim->start << ":" << xdim->start + xdim->length - 1 << "," << xdim->chunksize << ",0]";
+            window << y_min << "," << x_min << "," << y_max << "," << x_max;
+        } else {
+            zschema << "scidb4gdal_x=" << xdim->start << ":" << xdim->start + xdim->length - 1 << "," << xdim->chunksize << ",0,"
+                    << "scidb4gdal_y=" << ydim->start << ":" << ydim->start + ydim->length - 1 << "," << ydim->chunksize << ",0]";
+            window << x_min << "," << y_min << "," << x_max << "," << y_max;
+        }
+
+        stringstream zarr;
+        zarr << "redimension(apply(filter(input(<scidb4gdal_z:int32>[scidb4gdal_n=0:" << n - 1 << "," << std::min(n, (size_t)SCIDB4GDAL_DEFAULT_UPLOAD_CHUNKSIZE)
+             << ",0],'" << remoteFilename << "',-2,'(int32)'),scidb4gdal_z<>" << zoneNoData << "),"
+             << "scidb4gdal_zone,int64(scidb4gdal_z),"
+             << "scidb4gdal_x,scidb4gdal_n%" << nx << "+" << x_min << ","
+             << "scidb4gdal_y,scidb4gdal_n/" << nx << "+" << y_min << ")," << zschema.str() << ")";
+
+        // cells with the attribute's no data value do not contribute to the statistics, null values are ignored
+        // by the aggregates anyway
+        string values = "project(between(" + getSliceExpression(array, nband, x_min, y_min, x_max, y_max) + "," +
+                        window.str() + ")," + attr.name + ")";
+        MD md = attr.md[""];
+        if (md.find(SCIDB4GDAL_DEFAULTMDFIELD_NODATA) != md.end()) {
+            values = "filter(" + values + "," + getValidCondition(attr.name, md[SCIDB4GDAL_DEFAULTMDFIELD_NODATA]) + ")";
+        }
+
+        stringstream afl;
+        afl << "project(apply(redimension(apply(cross_join(" << values << " as a," << zarr.str() << " as z,"
+            << "a." << xdim->name << ",z.scidb4gdal_x,a." << ydim->name << ",z.scidb4gdal_y),"
+            << "scidb4gdal_v,double(" << attr.name << ")),"
+            << "<n:uint64 NULL,total:double NULL,mean:double NULL,sd:double NULL,vmin:double NULL,vmax:double NULL>"
+            << "[scidb4gdal_zone=" << z_min << ":" << z_max << "," << 1 + z_max - z_min << ",0],"
+            << "count(scidb4gdal_v) as n,sum(scidb4gdal_v) as total,avg(scidb4gdal_v) as mean,"
+            << "stdev(scidb4gdal_v) as sd,min(scidb4gdal_v) as vmin,max(scidb4gdal_v) as vmax),"
+            << "zone,scidb4gdal_zone),zone,n,total,mean,sd,vmin,vmax)";
+
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "tsv", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS) {
+            Utils::warn("Cannot compute zonal statistics of array '" + array.name + "'");
+            return res;
+        }
+
+        boost::algorithm::trim(response);
+        boost::replace_all(response, "\t", ",");
+        out = response;
+        if (!out.empty())
+            out += "\n";
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getHyperslab(SciDBSpatialArray& array, uint8_t nband, const vector<int64_t>& start,
+                                        const vector<uint64_t>& count, const vector<int64_t>& step, void* out) {
+        if (nband >= array.attrs.size() || start.size() != array.dims.size() || count.size() != array.dims.size() ||
+            step.size() != array.dims.size()) {
+            Utils::error("Invalid hyperslab request");
+            return ERR_READ_UNKNOWN;
+        }
+        SciDBAttribute& attr = array.attrs[nband];
+        string naval = getNoDataString(array, nband);
+
+        // lower and upper boundaries of the selection, strides are applied with a filter
+        stringstream lower, upper, stride, index, schema;
+        uint64_t n = 1;
+        for (uint32_t i = 0; i < array.dims.size(); ++i) {
+            int64_t s = (step[i] == 0) ? 1 : step[i];
+            int64_t last = start[i] + ((int64_t)count[i] - 1) * s;
+            int64_t lo = std::min(start[i], last);
+            string sep = (i > 0) ? "," : "";
+            lower << sep << lo;
+            upper << sep << std::max(start[i], last);
+            if (s != 1 && s != -1) {
+                stride << ((stride.str().empty()) ? "" : " and ") << "(" << array.dims[i].name << "-(" << lo << "))%"
+                       << ((s < 0) ? -s : s) << "=0";
+            }
+            index << ",scidb4gdal_i" << i << ",(" << array.dims[i].name << "-(" << start[i] << "))/(" << s << ")";
+            schema << sep << "scidb4gdal_i" << i << "=0:" << count[i] - 1 << "," << count[i] << ",0";
+            n *= count[i];
+        }
+        if (n == 0)
+            return SUCCESS;
+
+        string sel = "between(" + getInputExpression(array) + "," + lower.str() + "," + upper.str() + ")";
+        if (!stride.str().empty())
+            sel = "filter(" + sel + "," + stride.str() + ")";
+
+        string target = "<" + attr.name + ":" + attr.typeId + ((attr.nullable) ? " NULL" : " NOT NULL") + ">[" + schema.str() + "]";
+        stringstream afl;
+        afl << "merge(redimension(apply(" << sel << index.str() << ")," << target << ")," << "build(" << target << "," << naval
+            << "))";
+        if (attr.nullable) {
+            string afl_temp = afl.str();
+            afl.str("");
+            afl << "substitute(" << afl_temp << ", build(<val:" << attr.typeId << ">[i=0:0, 1, 0], " << naval << "))";
+        }
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(" + attr.typeId + ")", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        size_t expected = n * Utils::scidbTypeIdBytes(attr.typeId);
+        if (response.size() != expected) {
+            stringstream s;
+            s << "Unexpected size of hyperslab result: " << response.size() << " bytes instead of " << expected;
+            Utils::error(s.str());
+            return ERR_READ_UNKNOWN;
+        }
+        memcpy(out, response.data(), expected);
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getCellMask(SciDBSpatialArray& array, int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                                       vector<uint8_t>& out) {
+        SciDBDimension* xdim = array.getXDim();
+        SciDBDimension* ydim = array.getYDim();
+        int64_t nrows = 1 + y_max - y_min;
+        int64_t nbytes = (8 + x_max - x_min) / 8;
+        out.assign(nrows * nbytes, 0);
+
+        stringstream window;
+        if (array.getXDimIdx() > array.getYDimIdx())
+            window << y_min << "," << x_min << "," << y_max << "," << x_max;
+        else
+            window << x_min << "," << y_min << "," << x_max << "," << y_max;
+
+        stringstream schema;
+        schema << "<scidb4gdal_s:int64 NULL>[scidb4gdal_r=0:" << nrows - 1 << "," << nrows << ",0,"
+               << "scidb4gdal_b=0:" << nbytes - 1 << "," << nbytes << ",0]";
+
+        // cells are numbered by row and byte, existing cells contribute 2^k to the sum of their byte, the sum is
+        // nullable and must be substituted, binary save does not accept nullable attributes as plain (uint8)
+        stringstream afl;
+        afl << "substitute(project(apply(merge(redimension(apply(between(" << getSliceExpression(array, 0, x_min, y_min, x_max, y_max)
+            << "," << window.str() << "),"
+            << "scidb4gdal_r," << ydim->name << "-(" << y_min << "),"
+            << "scidb4gdal_b,(" << xdim->name << "-(" << x_min << "))/8,"
+            << "scidb4gdal_v,int64(pow(2.0,double((" << xdim->name << "-(" << x_min << "))%8)))),"
+            << schema.str() << ",sum(scidb4gdal_v) as scidb4gdal_s),"
+            << "build(" << schema.str() << ",0)),scidb4gdal_bits,uint8(scidb4gdal_s)),scidb4gdal_bits),"
+            << "build(<val:uint8>[i=0:0,1,0],0))";
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(uint8)", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        if (response.size() != out.size()) {
+            Utils::error("Unexpected size of cell mask result");
+            return ERR_READ_UNKNOWN;
+        }
+        memcpy(&out[0], response.data(), response.size());
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getBlockOccupancy(SciDBSpatialArray& array, int64_t x_min, int64_t y_min, int64_t x_max,
+                                             int64_t y_max, int32_t nBlockXSize, int32_t nBlockYSize, vector<int64_t>& out) {
+        out.clear();
+        SciDBDimension* xdim = array.getXDim();
+        SciDBDimension* ydim = array.getYDim();
+
+        // restrict to the temporal selection of spacetime arrays
+        int64_t t_min = -1, t_max = -1;
+        SciDBSpatioTemporalArray* starray = dynamic_cast<SciDBSpatioTemporalArray*>(&array);
+        if (starray) {
+            if (_qp && (_qp->hasTemporalRange || !_qp->reducer.empty())) {
+                t_min = _qp->lower_bound;
+                t_max = _qp->upper_bound;
+            } else if (_qp) {
+                t_min = t_max = _qp->temp_index;
+            } else {
+                t_min = starray->getTDim()->low;
+                t_max = starray->getTDim()->high;
+            }
+        }
 
+        stringstream lower, upper;
+        for (uint32_t i = 0; i < array.dims.size(); ++i) {
+            if (i > 0) {
+                lower << ",";
+                upper << ",";
+            }
+            if ((int)i == array.getXDimIdx()) {
+                lower << x_min;
+                upper << x_max;
+            } else if ((int)i == array.getYDimIdx()) {
+                lower << y_min;
+                upper << y_max;
+            } else if (starray && (int)i == starray->getTDimIdx()) {
+                lower << t_min;
+                upper << t_max;
+            } else {
+                lower << array.dims[i].low;
+                upper << array.dims[i].low;
+            }
+        }
+
+        int64_t bx_min = (x_min - xdim->low) / nBlockXSize;
+        int64_t bx_max = (x_max - xdim->low) / nBlockXSize;
+        int64_t by_min = (y_min - ydim->low) / nBlockYSize;
+        int64_t by_max = (y_max - ydim->low) / nBlockYSize;
+
+        stringstream afl;
+        afl << "project(apply(redimension(apply(between(" << getInputExpression(array) << "," << lower.str() << "," << upper.str() << "),"
+            << "scidb4gdal_bx,(" << xdim->name << "-(" << xdim->low << "))/" << nBlockXSize << ","
+            << "scidb4gdal_by,(" << ydim->name << "-(" << ydim->low << "))/" << nBlockYSize << "),"
+            << "<n:uint64 NULL>[scidb4gdal_by=" << by_min << ":" << by_max << "," << 1 + by_max - by_min << ",0,"
+            << "scidb4gdal_bx=" << bx_min << ":" << bx_max << "," << 1 + bx_max - bx_min << ",0],count(*) as n),"
+            << "bx,scidb4gdal_bx,by,scidb4gdal_by),bx,by)";
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(int64,int64)", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+
+        if (response.size() % (2 * sizeof(int64_t)) != 0) {
+            Utils::debug("Unexpected size of block occupancy result");
+            return ERR_READ_UNKNOWN;
+        }
+        out.resize(response.size() / sizeof(int64_t));
+        if (!out.empty())
+            memcpy(&out[0], response.data(), response.size());
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::getTemporalIndexes(SciDBSpatioTemporalArray& array, vector<int64_t>& out, bool refresh) {
+        out.clear();
+        // the index describes the stored array, hence it is only cached for versioned arrays without joins
+        bool cacheable = array.version > 0 && array.joins.empty() && hasSCIDB4GEO();
+
+        if (cacheable && !refresh) {
+            map<string, string> kv;
+            getArrayMD(kv, array.name, SCIDB4GDAL_MDDOMAIN_TINDEX);
+            if (kv.find("VERSION") != kv.end() && kv.find("INDEXES") != kv.end() &&
+                kv["VERSION"] == boost::lexical_cast<string>(array.version)) {
+                // ranges like 3:5;9 without commas, which separate metadata values
+                vector<string> ranges;
+                boost::split(ranges, kv["INDEXES"], boost::is_any_of(";"), boost::token_compress_on);
+                try {
+                    for (size_t i = 0; i < ranges.size(); ++i) {
+                        if (ranges[i].empty())
+                            continue;
+                        size_t sep = ranges[i].find(':');
+                        int64_t first = boost::lexical_cast<int64_t>(ranges[i].substr(0, sep));
+                        int64_t last = (sep == string::npos) ? first : boost::lexical_cast<int64_t>(ranges[i].substr(sep + 1));
+                        for (int64_t t = first; t <= last; ++t)
+                            out.push_back(t);
+                    }
+                    return SUCCESS;
+                } catch (boost::bad_lexical_cast e) {
+                    Utils::debug("Invalid temporal index in array metadata, recomputing");
+                    out.clear();
+                }
+            }
+        }
+
+        SciDBDimension* tdim = array.getTDim();
+        stringstream afl;
+        afl << "project(apply(aggregate(" << getSourceExpression(array) << ",count(*) as n," << tdim->name << "),"
+            << "scidb4gdal_t," << tdim->name << "),scidb4gdal_t)";
+
+        int sessionID = newSession();
+        string response;
+        StatusCode res = queryBinary(sessionID, afl.str(), "(int64)", response);
+        releaseSession(sessionID);
+        if (res != SUCCESS)
+            return res;
+        if (response.size() % sizeof(int64_t) != 0) {
+            Utils::debug("Unexpected size of temporal index result");
+            return ERR_READ_UNKNOWN;
+        }
+        out.resize(response.size() / sizeof(int64_t));
+        if (!out.empty())
+            memcpy(&out[0], response.data(), response.size());
+        std::sort(out.begin(), out.end());
+
+        // there is one stored index per array, readers of older versions must not replace the one of the latest
+        int64_t latest = 0;
+        if (cacheable && getArrayVersion(array.name, latest) == SUCCESS && latest == array.version) {
+            stringstream ranges;
+            for (size_t i = 0; i < out.size();) {
+                size_t j = i;
+                while (j + 1 < out.size() && out[j + 1] == out[j] + 1)
+                    ++j;
+                if (i > 0)
+                    ranges << ";";
+                ranges << out[i];
+                if (j > i)
+                    ranges << ":" << out[j];
+                i = j + 1;
+            }
+            map<string, string> kv;
+            kv["VERSION"] = boost::lexical_cast<string>(array.version);
+            kv["INDEXES"] = ranges.str();
+            setArrayMD(array.name, kv, SCIDB4GDAL_MDDOMAIN_TINDEX);
+        }
         return SUCCESS;
     }
 
@@ -1605,30 +2595,8 @@ namespace scidb4gdal {
         return !(std::isalnum(c) || c == '/' || c == '_' || c == '-' || c == '.');
     }
 
-    StatusCode ShimClient::insertData(SciDBSpatialArray& array, void* inChunk,
-                                    int32_t x_min, int32_t y_min, int32_t x_max,
-                                    int32_t y_max) {
-        // TODO: Do some checks
-
-        // Shim create session
-        int sessionID = newSession();
-
-        // Shim upload file from binary stream
-        string format = array.getFormatString();
-
-        // Get total size in bytes of one pixel, i.e. sum of attribute sizes
-        size_t pixelSize = 0;
-        uint32_t nx = (1 + x_max - x_min);
-        uint32_t ny = (1 + y_max - y_min);
-        for (uint32_t i = 0; i < array.attrs.size(); ++i)
-            pixelSize += Utils::scidbTypeIdBytes(array.attrs[i].typeId);
-        size_t totalSize = pixelSize * nx * ny;
-
-        Utils::debug("Upload file size " + boost::lexical_cast<string>(totalSize >> 10 >> 10) + "MB");
-
-        // UPLOAD FILE ////////////////////////////
+    StatusCode ShimClient::uploadFile(int sessionID, void* data, size_t size, string& remoteFilename) {
         stringstream ss;
-        ss.str("");
     #ifdef CURL_ADDPORTTOURL
         ss << _host << SHIMENDPOINT_UPLOAD_FILE;
     #else
@@ -1646,12 +2614,12 @@ namespace scidb4gdal {
         // Load file from buffer instead of file!
         // Form HTTP POST, first two pointers next the KVP for the form
         curl_formadd(&formpost, &lastptr, CURLFORM_COPYNAME, "file", CURLFORM_BUFFER,
-                    SCIDB4GDAL_DEFAULT_UPLOAD_FILENAME, CURLFORM_BUFFERPTR, inChunk,
-                    CURLFORM_BUFFERLENGTH, totalSize, CURLFORM_CONTENTTYPE,
+                    SCIDB4GDAL_DEFAULT_UPLOAD_FILENAME, CURLFORM_BUFFERPTR, data,
+                    CURLFORM_BUFFERLENGTH, size, CURLFORM_CONTENTTYPE,
                     "application/octet-stream", CURLFORM_END);
 
         curlBegin();
-        string remoteFilename = "";
+        remoteFilename = "";
         // curl_easy_setopt(_curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
 
         curl_easy_setopt(_curl_handle, CURLOPT_URL, ss.str().c_str());
@@ -1661,6 +2629,7 @@ namespace scidb4gdal {
 
         if (curlPerform() != CURLE_OK) {
             curlEnd();
+            curl_formfree(formpost);
             return ERR_CREATE_UNKNOWN;
         }
         curlEnd();
@@ -1671,6 +2640,36 @@ namespace scidb4gdal {
                                             remoteFilename.end(),
                                             isIllegalFilenameCharacter),
                             remoteFilename.end());
+        return SUCCESS;
+    }
+
+    StatusCode ShimClient::insertData(SciDBSpatialArray& array, void* inChunk,
+                                    int64_t x_min, int64_t y_min, int64_t x_max,
+                                    int64_t y_max) {
+        // TODO: Do some checks
+
+        // Shim create session
+        int sessionID = newSession();
+
+        // Shim upload file from binary stream
+        string format = array.getFormatString();
+
+        // Get total size in bytes of one pixel, i.e. sum of attribute sizes
+        size_t pixelSize = 0;
+        uint64_t nx = (1 + x_max - x_min);
+        uint64_t ny = (1 + y_max - y_min);
+        for (uint32_t i = 0; i < array.attrs.size(); ++i)
+            pixelSize += Utils::scidbTypeIdBytes(array.attrs[i].typeId);
+        size_t totalSize = pixelSize * nx * ny;
+
+        Utils::debug("Upload file size " + boost::lexical_cast<string>(totalSize >> 10 >> 10) + "MB");
+
+        // UPLOAD FILE ////////////////////////////
+        string remoteFilename = "";
+        if (uploadFile(sessionID, inChunk, totalSize, remoteFilename) != SUCCESS) {
+            return ERR_CREATE_UNKNOWN;
+        }
+        stringstream ss;
 
         // Load data from file to SciDB array
         stringstream afl_input;
@@ -1745,18 +2744,18 @@ namespace scidb4gdal {
         // create an output table based on the name of array
         // min(), max(),avg(),stdev()
         // and save it as 4 double values
-        afl << "aggregate(" << array.name << ",min(" << aname << "),max(" << aname << "),avg(" << aname << "),stdev(" << aname << "))";
+        afl << "aggregate(" << getInputExpression(array) << ",min(" << aname << "),max(" << aname << "),avg(" << aname << "),stdev(" << aname << "))";
         Utils::debug("Performing AFL Query: " + afl.str());
 
+        curlBegin();
         ss.str();
         ss << _host << SHIMENDPOINT_EXECUTEQUERY << "?"
-        << "id=" << sessionID << "&query=" << afl.str() << "&save="
+        << "id=" << sessionID << "&query=" << curl_easy_escape(_curl_handle, afl.str().c_str(), 0) << "&save="
         << "(double,double,double,double)";
         // Add auth parameter if using ssl
         if (_ssl && !_auth.empty())
             ss << "&auth=" << _auth;
 
-        curlBegin();
         curl_easy_setopt(_curl_handle, CURLOPT_URL, ss.str().c_str());
         curl_easy_setopt(_curl_handle, CURLOPT_HTTPGET, 1);
         curlPerform();
@@ -39,6 +39,7 @@ SOFTWARE.
 
 #include "affinetransform.h"
 #include "utils.h"
+#include "cpl_multiproc.h"
 
 
 #define SHIMENDPOINT_NEW_SESSION "/new_session"
@@ -115,6 +116,8 @@ namespace scidb4gdal {
     class ShimClient {
     public:
         friend class SciDBDataset;
+        friend class SciDBRasterBand;
+        friend class SciDBMDArray;
         /**
         * @brief Basic constructor
         *
@@ -162,6 +165,83 @@ namespace scidb4gdal {
         */
         StatusCode getArrayDesc(const string& inArrayName, SciDBSpatialArray*& out);
 
+        /**
+        * @brief Derives the attributes that result from the apply expressions of the query parameters
+        *
+        * Asks SciDB for the output schema of apply() on the given array with show(), such that data types and nullability of derived
+        * attributes are inferred by the database. The stated attributes are replaced by the derived attributes only.
+        *
+        * @param inArrayName name of a SciDB array or AFL expression of joined arrays
+        * @param out attributes of the array, will be replaced by derived attributes (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getDerivedAttributeDesc(const string& inArrayName, vector<SciDBAttribute>& out);
+
+        /**
+        * @brief Fetches the most recent version of an array
+        *
+        * @param inArrayName name of a SciDB array
+        * @param out most recent version id, 0 if the array does not keep versions, e.g. temporary arrays (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getArrayVersion(const string& inArrayName, int64_t& out);
+
+        /**
+        * @brief Fetches the ids of all arrays in the database
+        *
+        * The unversioned id (uaid) identifies an array instance, i.e. it changes if an array is removed and created again
+        * under the same name, the versioned id (aid) additionally changes with every new array version.
+        *
+        * @param out array names mapped to their unversioned and versioned ids (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getArrayIds(map<string, pair<int64_t, int64_t> >& out);
+
+        /**
+        * @brief Lists the ids of all arrays an AFL expression refers to
+        *
+        * @param expr AFL expression
+        * @param ids ids of all arrays as returned by getArrayIds()
+        * @param versioned true to list versioned ids (aid), false to list instance ids (uaid)
+        * @return "|name:id" for every known array name in expr, in the order of occurrence
+        */
+        static string getReferencedArrayIds(const string& expr, const map<string, pair<int64_t, int64_t> >& ids,
+                                            bool versioned);
+
+        /**
+        * @brief Materializes the result of an AFL query as temporary array
+        *
+        * The array name is derived from a hash of the server, the query and the versioned ids of all arrays the query
+        * refers to, plus a token that is unique to this process among all clients. Datasets of the same process share
+        * the array as long as inputs are unchanged, it is reference counted and must be released with
+        * releaseMaterializedQuery(). Otherwise, a temporary array with the schema of the query result is created and
+        * filled with store(). Existing arrays of the same name are never replaced.
+        *
+        * @param query AFL query
+        * @param arrayname name of the array that contains the query result (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode materializeQuery(const string& query, string& arrayname);
+
+        /**
+        * @brief Releases a materialized query result, the array is removed when its last user releases it
+        * @param arrayname name of the array as returned by materializeQuery()
+        */
+        void releaseMaterializedQuery(const string& arrayname);
+
+        /**
+        * @brief Joins the attributes of another array on the same grid to an array
+        *
+        * Reads of the other array are pinned to its most recent version. Attributes whose names already exist in the
+        * array are renamed to <other array>_<attribute> with cast(). The renamed attributes are appended to the array's
+        * attributes, such that all of them are read with a single join() query.
+        *
+        * @param array metadata of the array to join to
+        * @param other metadata of the joined array, dimensions must match those of array
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode joinArray(SciDBSpatialArray& array, SciDBSpatialArray& other);
+
         /**
         * @brief Retreives single attribute data from shim for a given bounding box
         *
@@ -178,11 +258,161 @@ namespace scidb4gdal {
         * @param ymax upper boundary, we assume y to be "northing" which is different from GDAL!
         * @param use_subarray whether or not subarrays are used.
         * @param emptycheck a boolean to state whether or not to check for empty cells
+        * @param castType narrower SciDB integer type (uint8, int16 or uint16) the values are converted to server-side
+        * with rounding and clamping, empty to transfer the attribute type
         * @return scidb4gdal::StatusCode
         */
         StatusCode getData(SciDBSpatialArray& array, uint8_t nband, void* outchunk,
-                        int32_t x_min, int32_t y_min, int32_t x_max, int32_t y_max,
-                        bool use_subarray = true, bool emptycheck = true);
+                        int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                        bool use_subarray = true, bool emptycheck = true, const string& castType = "");
+
+        /**
+        * @brief Retrieves several attributes of a bounding box with a single query
+        *
+        * Used to read the attributes of joined arrays in one round trip. Values are returned cell by cell, i.e. all
+        * requested attributes of the first cell followed by those of the second cell, in the order of the cells of getData().
+        * Empty cells and null values are replaced by each attribute's no data value.
+        *
+        * @param array metadata of an existing array
+        * @param nbands indexes of the requested attributes
+        * @param outchunk pointer to preallocated memory for all cells times the sum of the attribute sizes (output)
+        * @param x_min left boundary
+        * @param y_min lower boundary
+        * @param x_max right boundary
+        * @param y_max upper boundary
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getAttributesData(SciDBSpatialArray& array, const vector<uint8_t>& nbands, void* outchunk,
+                                     int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max);
+
+        /**
+        * @brief Retreives the complete time series of a spatial window from a spacetime array
+        *
+        * Instead of slicing the array once per temporal index, this function runs a single between() query over the whole
+        * temporal range [t_min, t_max] and the given spatial window. The result is redimensioned into a single chunk, so that
+        * the binary output is ordered by time first, then by y and x. Empty cells are filled with the attribute's no data value.
+        *
+        * @param array metadata of an existing spacetime array
+        * @param nband index of the requested attribute (starting with 0)
+        * @param outchunk pointer to preallocated memory for (1 + t_max - t_min) * (1 + y_max - y_min) * (1 + x_max - x_min) cells
+        * @param x_min left boundary in array coordinates
+        * @param y_min lower boundary in array coordinates
+        * @param x_max right boundary in array coordinates
+        * @param y_max upper boundary in array coordinates
+        * @param t_min first temporal index
+        * @param t_max last temporal index
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getTimeSeries(SciDBSpatioTemporalArray& array, uint8_t nband, void* outchunk,
+                                 int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                                 int64_t t_min, int64_t t_max);
+
+        /**
+        * @brief Retreives single attribute values at a list of cells with one query
+        *
+        * The cell coordinates are uploaded as a small array, redimensioned to the spatial dimensions of the array and
+        * joined with the (temporally sliced or composited) array using cross_join(). Cells without data get the attribute's
+        * no data value. Coordinates must be unique.
+        *
+        * @param array metadata of an existing array
+        * @param nband index of the requested attribute (starting with 0)
+        * @param cells array coordinates of the requested cells as x, y pairs
+        * @param out pointer to preallocated memory for cells.size() / 2 values of the attribute's data type (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getPointValues(SciDBSpatialArray& array, uint8_t nband, const vector<int64_t>& cells, void* out);
+
+        /**
+        * @brief Computes statistics of a single attribute per zone of an uploaded zone raster
+        *
+        * The zone raster is uploaded as one-dimensional array, redimensioned to the spatial dimensions of the array,
+        * joined with the (temporally sliced or composited) array and aggregated by zone with redimension(). Only the
+        * resulting table is transferred. Cells with the attribute's no data value or without zone are ignored.
+        *
+        * @param array metadata of an existing array
+        * @param nband index of the requested attribute (starting with 0)
+        * @param zones zone ids of the window, row by row starting at x_min, y_min
+        * @param zoneNoData zone id of cells that do not belong to any zone
+        * @param x_min left boundary of the window in array coordinates
+        * @param y_min lower boundary of the window in array coordinates
+        * @param x_max right boundary of the window in array coordinates
+        * @param y_max upper boundary of the window in array coordinates
+        * @param out one line zone,count,sum,mean,stdev,min,max per zone with at least one cell (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getZonalStatistics(SciDBSpatialArray& array, uint8_t nband, const int32_t* zones, int32_t zoneNoData,
+                                      int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max, string& out);
+
+        /**
+        * @brief Finds the non-empty blocks of a spatial window
+        *
+        * Cells of the window are grouped by blocks of size nBlockXSize x nBlockYSize, counted from the lower boundaries of the
+        * spatial dimensions, and only coordinates of blocks with at least one cell are returned. Since cells are counted with
+        * count(*), no attribute data needs to be read. For spacetime arrays, the temporal selection of the query parameters is
+        * taken into account.
+        *
+        * @param array metadata of an existing array
+        * @param x_min left boundary of the window in array coordinates
+        * @param y_min lower boundary of the window in array coordinates
+        * @param x_max right boundary of the window in array coordinates
+        * @param y_max upper boundary of the window in array coordinates
+        * @param nBlockXSize block size in x direction
+        * @param nBlockYSize block size in y direction
+        * @param out block coordinates of non-empty blocks as x, y pairs (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getBlockOccupancy(SciDBSpatialArray& array, int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                                     int32_t nBlockXSize, int32_t nBlockYSize, vector<int64_t>& out);
+
+        /**
+        * @brief Lists the temporal indexes of a spacetime array that contain at least one cell
+        *
+        * The index is computed with a single aggregate grouped by the temporal dimension and stored in the array metadata
+        * domain SCIDB4GDAL_MDDOMAIN_TINDEX together with the array version. Later calls reuse the stored index as long as
+        * the version matches. Indexes of versions other than the latest are computed but not stored.
+        *
+        * @param array metadata of an existing spacetime array
+        * @param out sorted temporal indexes with data (output)
+        * @param refresh recompute the index even if a stored index matches the version
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getTemporalIndexes(SciDBSpatioTemporalArray& array, vector<int64_t>& out, bool refresh = false);
+
+        /**
+        * @brief Retreives a strided N-dimensional hyperslab of a single attribute with one query
+        *
+        * In contrast to getData(), all dimensions of the array are addressed, including temporal and further dimensions.
+        * Selected cells are renumbered with redimension() into a single chunk, such that the result arrives in row-major
+        * order of the array's dimensions. Empty cells get the attribute's no data value.
+        *
+        * @param array metadata of an existing array
+        * @param nband index of the requested attribute (starting with 0)
+        * @param start first index per dimension in array coordinates
+        * @param count number of selected indexes per dimension
+        * @param step distance between selected indexes per dimension, may be negative
+        * @param out pointer to preallocated memory for the product of count values of the attribute's data type (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getHyperslab(SciDBSpatialArray& array, uint8_t nband, const vector<int64_t>& start,
+                                const vector<uint64_t>& count, const vector<int64_t>& step, void* out);
+
+        /**
+        * @brief Fetches which cells of a spatial window exist in the array as bit-packed mask
+        *
+        * Bits are packed in the database by summing powers of two with redimension(), such that only one bit per cell is
+        * transferred. Rows start at y_min and are padded to full bytes, bit k of byte b of a row represents the cell
+        * x_min + 8 * b + k. As all attributes of a cell are either empty or not, the mask is the same for all bands.
+        *
+        * @param array metadata of an existing array
+        * @param x_min left boundary of the window in array coordinates
+        * @param y_min lower boundary of the window in array coordinates
+        * @param x_max right boundary of the window in array coordinates
+        * @param y_max upper boundary of the window in array coordinates
+        * @param out bit-packed mask, resized to (1 + y_max - y_min) * ((8 + x_max - x_min) / 8) bytes (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getCellMask(SciDBSpatialArray& array, int64_t x_min, int64_t y_min, int64_t x_max, int64_t y_max,
+                               vector<uint8_t>& out);
 
         /**
         * @brief Fetches the band statistics of the data from the SciDB database
@@ -284,8 +514,8 @@ namespace scidb4gdal {
         * @param ymax upper boundary, we assume y to be "northing" which is different from GDAL!
         * @return scidb4gdal::StatusCode
         */
-        StatusCode insertData(SciDBSpatialArray& array, void* inChunk, int32_t x_min,
-                            int32_t y_min, int32_t x_max, int32_t y_max);
+        StatusCode insertData(SciDBSpatialArray& array, void* inChunk, int64_t x_min,
+                            int64_t y_min, int64_t x_max, int64_t y_max);
 
         /**
         * @brief Inserts an array in SciDB into another one if they are compatible
@@ -546,6 +776,154 @@ namespace scidb4gdal {
         */
         bool isVersionGreaterThan(int maj, int min);
 
+        /**
+        * @brief Returns the no data value of an attribute as it can be used in AFL queries
+        *
+        * Uses the NODATA attribute metadata if available and the default no data value of the attribute's data type otherwise.
+        *
+        * @param array metadata of an existing array
+        * @param nband attribute index, 0 based
+        * @param stored if true, the default refers to the attribute's type in the stored array instead of the type of
+        * returned values, which differ for averaged composites
+        * @return string representation of the no data value
+        */
+        string getNoDataString(SciDBSpatialArray& array, uint8_t nband, bool stored = false);
+
+        /**
+        * @brief Returns the AFL expression that reads attributes of a bounding box as used by getData()
+        *
+        * @param array metadata of an existing array
+        * @param nbands indexes of the requested attributes
+        * @param x_min left boundary
+        * @param y_min lower boundary
+        * @param x_max right boundary
+        * @param y_max upper boundary
+        * @param use_subarray whether or not subarrays are used
+        * @param emptycheck whether or not empty cells are filled with no data values
+        * @return string AFL expression
+        */
+        string getDataExpression(SciDBSpatialArray& array, const vector<uint8_t>& nbands, int64_t x_min, int64_t y_min,
+                                 int64_t x_max, int64_t y_max, bool use_subarray, bool emptycheck);
+
+        /**
+        * @brief Runs a query and reads its binary result
+        *
+        * @param afl AFL query
+        * @param saveFormat binary save format, e.g. (int16,double)
+        * @param outchunk pointer to preallocated memory for the complete result (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode readBinary(const string& afl, const string& saveFormat, void* outchunk);
+
+        /**
+        * @brief Returns an AFL filter condition that excludes cells with the no data value
+        *
+        * @param attrname attribute name
+        * @param naval no data value as returned by getNoDataString()
+        * @return string AFL expression
+        */
+        string getValidCondition(const string& attrname, const string& naval);
+
+        /**
+        * @brief Returns the AFL expression of the stored array(s) without query parameters
+        *
+        * This is the array name, followed by @version if reads are pinned to an array version, and joined with all arrays
+        * added by joinArray().
+        *
+        * @param array metadata of an existing array
+        * @return string AFL expression
+        */
+        string getSourceExpression(SciDBSpatialArray& array);
+
+        /**
+        * @brief Returns the AFL expression to read data from
+        *
+        * This is the source expression as returned by getSourceExpression(), wrapped in filter() and apply() if the query
+        * parameters contain filter or apply expressions.
+        *
+        * @param array metadata of an existing array
+        * @return string AFL expression
+        */
+        string getInputExpression(SciDBSpatialArray& array);
+
+        /**
+        * @brief Returns the two-dimensional AFL expression that bands are read from
+        *
+        * Spacetime arrays are sliced at the temporal index of the query or creation parameters, or composited if the
+        * query parameters contain a reducer. Other arrays are returned as given by getInputExpression().
+        *
+        * @param array metadata of an existing array
+        * @param nband index of the requested attribute, 0 based
+        * @param x_min left boundary in array coordinates
+        * @param y_min lower boundary in array coordinates
+        * @param x_max right boundary in array coordinates
+        * @param y_max upper boundary in array coordinates
+        * @return string AFL expression
+        */
+        string getSliceExpression(SciDBSpatialArray& array, uint8_t nband, int64_t x_min, int64_t y_min, int64_t x_max,
+                                  int64_t y_max);
+
+        /**
+        * @brief Builds an AFL expression that composites the temporal interval of the query parameters
+        *
+        * The temporal interval is reduced per pixel with the reducer of the query parameters (min, max, mean, median or latest valid
+        * observation), resulting in a two-dimensional array with the spatial dimensions of the input array and a single attribute
+        * with the name of the reduced attribute. No data cells are excluded from the reduction. To avoid aggregating the whole
+        * array, the input is restricted to the requested spatial window.
+        *
+        * @param array metadata of an existing spacetime array
+        * @param nband index of the attribute to be reduced, 0 based
+        * @param x_min left boundary in array coordinates
+        * @param y_min lower boundary in array coordinates
+        * @param x_max right boundary in array coordinates
+        * @param y_max upper boundary in array coordinates
+        * @return string AFL expression
+        */
+        string getCompositeExpression(SciDBSpatioTemporalArray& array, uint8_t nband, int64_t x_min, int64_t y_min,
+                                      int64_t x_max, int64_t y_max);
+
+        /**
+        * @brief Runs an AFL query within an existing session and reads the complete binary result
+        *
+        * In contrast to reading into preallocated memory, the result is appended to a string and can thus have arbitrary size.
+        *
+        * @param sessionID integer session ID
+        * @param afl the AFL query
+        * @param format SciDB binary format string of the result, e.g. "(int16,double)"
+        * @param out result bytes (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode queryBinary(int sessionID, const string& afl, const string& format, string& out);
+
+        /**
+        * @brief Runs an AFL query within an existing session without reading its result
+        *
+        * @param sessionID integer session ID
+        * @param afl the AFL query
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode executeQuery(int sessionID, const string& afl);
+
+        /**
+        * @brief Uploads a memory buffer as file to the shim server
+        *
+        * @param sessionID integer session ID
+        * @param data pointer to the data to be uploaded
+        * @param size size of the data in bytes
+        * @param remoteFilename name of the uploaded file at the server, which can be used with input() (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode uploadFile(int sessionID, void* data, size_t size, string& remoteFilename);
+
+        /**
+        * @brief Derives the output schema of an AFL query without running it
+        *
+        * @param afl the AFL query
+        * @param schema output schema without array name, e.g. "<a:int16> [x=0:99,100,0]" (output)
+        * @return scidb4gdal::StatusCode
+        */
+        StatusCode getQuerySchema(const string& afl, string& schema);
+
         /**
         * @brief Login to the SHIM web client
         *
@@ -599,6 +977,12 @@ namespace scidb4gdal {
         bool* _hasSCIDB4GEO;
         /** version of Shim */
         string _shimversion;
+        /** materialized query results of this process and their number of users */
+        static map<string, int> _materialized;
+        /** guards _materialized and _processToken */
+        static CPLMutex* _materializedMutex;
+        /** identifies this process among all clients of the database, suffix of materialized query results */
+        static string _processToken;
     };
     
     
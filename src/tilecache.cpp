@@ -23,63 +23,520 @@ SOFTWARE.
 -----------------------------------------------------------------------------*/
 
 #include "tilecache.h"
+#include "cpl_conv.h"
+#include "cpl_vsi.h"
+#include "cpl_string.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <boost/algorithm/string.hpp>
 
 namespace scidb4gdal {
 
+    BufferPool::BufferPool() : _idleSize(0), _allocations(0), _reuses(0), _mutex(NULL) {}
+
+    BufferPool::~BufferPool() {
+        for (map<size_t, vector<void*> >::iterator it = _idle.begin(); it != _idle.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); ++i)
+                free(it->second[i]);
+        }
+        if (_mutex != NULL)
+            CPLDestroyMutex(_mutex);
+    }
+
+    void* BufferPool::acquire(size_t size) {
+        {
+            CPLMutexHolderD(&_mutex);
+            vector<void*>& idle = _idle[size]; // registers the size class
+            if (!idle.empty()) {
+                void* data = idle.back();
+                idle.pop_back();
+                _idleSize -= size;
+                ++_reuses;
+                return data;
+            }
+            ++_allocations;
+        }
+        return malloc(size);
+    }
+
+    void BufferPool::release(void* data, size_t size) {
+        if (data == NULL)
+            return;
+        {
+            CPLMutexHolderD(&_mutex);
+            map<size_t, vector<void*> >::iterator it = _idle.find(size);
+            if (it != _idle.end() && _idleSize + size <= (size_t)SCIDB4GDAL_POOL_MAX_MB * 1024 * 1024) {
+                it->second.push_back(data);
+                _idleSize += size;
+                return;
+            }
+        }
+        free(data);
+    }
+
+    string BufferPool::stats() {
+        CPLMutexHolderD(&_mutex);
+        stringstream s;
+        s << _allocations << " allocations, " << _reuses << " reused buffers";
+        return s.str();
+    }
+
     TileCache::TileCache()
-        : _totalSize(0), _maxSize(SCIDB4GEO_MAXCHUNKCACHE_MB * 1024 * 1024) {}
+        : _totalSize(0), _maxSize(SCIDB4GEO_MAXCHUNKCACHE_MB * 1024 * 1024), _hits(0), _misses(0), _evictions(0),
+          _pool(NULL) {}
 
     TileCache::~TileCache() {
         clear();
-        _cache.clear();
-        _q.clear();
     }
 
-    bool TileCache::has(uint32_t id) {
-        map<uint32_t, ArrayTile>::iterator it;
-        return _cache.find(id) != _cache.end();
+    bool TileCache::has(const TileKey& key) {
+        return _cache.find(key) != _cache.end();
     }
 
-    void TileCache::remove(uint32_t id) {
-        map<uint32_t, ArrayTile>::iterator it = _cache.find(id);
+    void TileCache::remove(TileKey key) {
+        boost::unordered_map<TileKey, Entry>::iterator it = _cache.find(key);
         if (it != _cache.end()) {
-            ArrayTile temp = it->second;
-            free(temp.data);
-            _totalSize -= temp.size;
+            // compressed tiles have individual sizes and are not worth pooling
+            if (_pool != NULL && it->second.tile.storedSize == 0)
+                _pool->release(it->second.tile.data, it->second.tile.size);
+            else
+                free(it->second.tile.data);
+            _totalSize -= it->second.tile.memSize();
+            _lru.erase(it->second.pos);
             _cache.erase(it);
-            _q.remove(id);
         }
     }
 
     void TileCache::clear() {
-        while (!_q.empty()) {
-            remove(_q.front());
+        while (!_lru.empty()) {
+            remove(_lru.back());
         }
     }
 
-    void TileCache::add(ArrayTile c) {
+    void TileCache::setMaxSize(size_t bytes) {
+        _maxSize = bytes;
+        while (_totalSize > _maxSize && !_lru.empty()) {
+            remove(_lru.back());
+            ++_evictions;
+        }
+    }
+
+    bool TileCache::add(ArrayTile c) {
         // Assert that chunk has not been cached already
-        if (has(c.id))
+        if (has(c.key()))
+            return false;
+
+        if (c.memSize() > _maxSize) {
+            Utils::warn("Local array tile cache to small to store a single chunk, "
+                        "please consider either increasing local cache size or "
+                        "reducing gdal block size");
+            return false;
+        }
+
+        // Remove least recently used tiles until the new one fits
+        while (freeSpace() < c.memSize()) {
+            remove(_lru.back());
+            ++_evictions;
+        }
+        _lru.push_front(c.key());
+        Entry& e = _cache[c.key()];
+        e.tile = c;
+        e.pos = _lru.begin();
+        _totalSize += c.memSize();
+        return true;
+    }
+
+    ArrayTile* TileCache::get(const TileKey& key) {
+        boost::unordered_map<TileKey, Entry>::iterator it = _cache.find(key);
+        if (it == _cache.end()) {
+            ++_misses;
+            return NULL;
+        }
+        ++_hits;
+        _lru.splice(_lru.begin(), _lru, it->second.pos);
+        return &it->second.tile;
+    }
+
+    DiskTileCache::DiskTileCache(const string& dir, size_t maxSize)
+        : _dir(dir), _maxSize(maxSize), _totalSize(0), _mutex(NULL) {
+        VSIMkdir(_dir.c_str(), 0755);
+        CPLMutexHolderD(&_mutex);
+        scan(true);
+        while (_totalSize > _maxSize && !_lru.empty())
+            remove(_lru.front());
+    }
+
+    void DiskTileCache::scan(bool startup) {
+        // files unknown so far are appended oldest first, known files keep their usage order
+        vector<pair<long, string> > found;
+        boost::unordered_map<string, bool> present;
+        char** files = VSIReadDir(_dir.c_str());
+        for (int i = 0; files != NULL && files[i] != NULL; ++i) {
+            string name = files[i];
+            bool tile = boost::algorithm::ends_with(name, ".tile");
+            if (!tile && !(startup && boost::algorithm::ends_with(name, ".tmp")))
+                continue;
+            string path = CPLFormFilename(_dir.c_str(), name.c_str(), NULL);
+            VSIStatBufL st;
+            if (VSIStatL(path.c_str(), &st) != 0)
+                continue;
+            if (!tile) {
+                // files left behind by writers that died, other processes sharing the directory may still be writing
+                // recent ones
+                if (time(NULL) - st.st_mtime > SCIDB4GDAL_DISK_CACHE_TMP_AGE)
+                    VSIUnlink(path.c_str());
+                continue;
+            }
+            present[name] = true;
+            if (_files.find(name) == _files.end())
+                found.push_back(pair<long, string>((long)st.st_mtime, name));
+            else
+                _totalSize -= _files[name].first;
+            _files[name].first = (size_t)st.st_size;
+            _totalSize += (size_t)st.st_size;
+        }
+        CSLDestroy(files);
+
+        // files removed by other processes
+        for (list<string>::iterator it = _lru.begin(); it != _lru.end();) {
+            list<string>::iterator next = it;
+            ++next;
+            if (present.find(*it) == present.end()) {
+                _totalSize -= _files[*it].first;
+                _files.erase(*it);
+                _lru.erase(it);
+            }
+            it = next;
+        }
+
+        std::sort(found.begin(), found.end());
+        for (size_t i = 0; i < found.size(); ++i) {
+            _lru.push_back(found[i].second);
+            _files[found[i].second].second = --_lru.end();
+        }
+    }
+
+    DiskTileCache::~DiskTileCache() {
+        if (_mutex != NULL)
+            CPLDestroyMutex(_mutex);
+    }
+
+    bool DiskTileCache::has(const string& name) {
+        CPLMutexHolderD(&_mutex);
+        if (_files.find(name) != _files.end())
+            return true;
+        // written by another process sharing the directory
+        VSIStatBufL st;
+        if (VSIStatL(CPLFormFilename(_dir.c_str(), name.c_str(), NULL), &st) != 0)
+            return false;
+        _lru.push_back(name);
+        _files[name] = pair<size_t, list<string>::iterator>((size_t)st.st_size, --_lru.end());
+        _totalSize += (size_t)st.st_size;
+        return true;
+    }
+
+    void DiskTileCache::touch(const string& name) {
+        boost::unordered_map<string, pair<size_t, list<string>::iterator> >::iterator it = _files.find(name);
+        if (it != _files.end())
+            _lru.splice(_lru.end(), _lru, it->second.second);
+    }
+
+    void DiskTileCache::remove(const string& name) {
+        boost::unordered_map<string, pair<size_t, list<string>::iterator> >::iterator it = _files.find(name);
+        if (it == _files.end())
             return;
+        VSIUnlink(CPLFormFilename(_dir.c_str(), name.c_str(), NULL));
+        _totalSize -= it->second.first;
+        _lru.erase(it->second.second);
+        _files.erase(it);
+    }
+
+    bool DiskTileCache::read(const string& name, void* dst, size_t size) {
+        {
+            CPLMutexHolderD(&_mutex);
+            if (_files.find(name) == _files.end())
+                return false;
+            touch(name);
+        }
+        string path = CPLFormFilename(_dir.c_str(), name.c_str(), NULL);
+        VSILFILE* fp = VSIFOpenL(path.c_str(), "rb");
+        bool ok = false;
+        if (fp != NULL) {
+            ok = VSIFReadL(dst, 1, size, fp) == size;
+            // files must not be longer than expected either
+            char extra;
+            ok = ok && VSIFReadL(&extra, 1, 1, fp) == 0;
+            VSIFCloseL(fp);
+        }
+        if (!ok) {
+            // removed by another process or not matching the expected tile size
+            CPLMutexHolderD(&_mutex);
+            remove(name);
+        }
+        return ok;
+    }
 
-        // Check whether enough memory, if not, delete front (oldest) element
-        while (freeSpace() < c.size) {
-            if (_q.empty()) {
-                Utils::warn("Local array tile cache to small to store a single chunk, "
-                            "please consider either increasing local cache size or "
-                            "reducing gdal block size");
+    void DiskTileCache::write(const string& name, const void* data, size_t size) {
+        if (size > _maxSize)
+            return;
+        {
+            CPLMutexHolderD(&_mutex);
+            if (_files.find(name) != _files.end())
                 return;
+        }
+        string path = CPLFormFilename(_dir.c_str(), name.c_str(), NULL);
+        stringstream tmp;
+        // CPLGetPID() identifies the calling thread, the process id keeps processes sharing the directory apart
+#ifdef WIN32
+        tmp << path << "." << GetCurrentProcessId() << "_" << CPLGetPID() << ".tmp";
+#else
+        tmp << path << "." << getpid() << "_" << CPLGetPID() << ".tmp";
+#endif
+        VSILFILE* fp = VSIFOpenL(tmp.str().c_str(), "wb");
+        if (fp == NULL) {
+            Utils::debug("Cannot write tile file '" + tmp.str() + "'");
+            return;
+        }
+        bool ok = VSIFWriteL(data, 1, size, fp) == size;
+        ok = (VSIFCloseL(fp) == 0) && ok;
+        if (!ok || VSIRename(tmp.str().c_str(), path.c_str()) != 0) {
+            VSIUnlink(tmp.str().c_str());
+            return;
+        }
+
+        CPLMutexHolderD(&_mutex);
+        if (_files.find(name) != _files.end())
+            return;
+        _lru.push_back(name);
+        _files[name] = pair<size_t, list<string>::iterator>(size, --_lru.end());
+        _totalSize += size;
+        // other processes sharing the directory write and remove files as well, the budget applies to all of them
+        if (_totalSize > _maxSize) {
+            scan(false);
+            touch(name);
+        }
+        while (_totalSize > _maxSize && _lru.size() > 1)
+            remove(_lru.front());
+    }
+
+    SharedTileCache* SharedTileCache::_instance = NULL;
+    CPLMutex* SharedTileCache::_instanceMutex = NULL;
+
+    SharedTileCache& SharedTileCache::instance() {
+        CPLMutexHolderD(&_instanceMutex);
+        if (_instance == NULL)
+            _instance = new SharedTileCache();
+        return *_instance;
+    }
+
+    void SharedTileCache::destroy() {
+        {
+            CPLMutexHolderD(&_instanceMutex);
+            delete _instance;
+            _instance = NULL;
+        }
+        if (_instanceMutex != NULL) {
+            CPLDestroyMutex(_instanceMutex);
+            _instanceMutex = NULL;
+        }
+    }
+
+    SharedTileCache::SharedTileCache() : _compress(false), _disk(NULL), _nextContext(1), _contextMutex(NULL) {
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            _mutexes[i] = NULL;
+            _shards[i].setPool(&_pool);
+        }
+        double mb = CPLAtof(CPLGetConfigOption("SCIDB4GDAL_CACHE_MB", "0"));
+        setMaxSize((size_t)((mb > 0 ? mb : SCIDB4GEO_MAXCHUNKCACHE_MB) * 1024 * 1024));
+        _compress = CSLTestBoolean(CPLGetConfigOption("SCIDB4GDAL_CACHE_COMPRESS", "NO"));
+
+        const char* dir = CPLGetConfigOption("SCIDB4GDAL_DISK_CACHE_DIR", NULL);
+        if (dir != NULL && dir[0] != '\0') {
+            double diskmb = CPLAtof(CPLGetConfigOption("SCIDB4GDAL_DISK_CACHE_MB", "0"));
+            _disk = new DiskTileCache(dir, (size_t)((diskmb > 0 ? diskmb : SCIDB4GDAL_DISK_CACHE_MB) * 1024 * 1024));
+        }
+    }
+
+    SharedTileCache::~SharedTileCache() {
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            _shards[i].clear();
+            if (_mutexes[i] != NULL)
+                CPLDestroyMutex(_mutexes[i]);
+        }
+        if (_contextMutex != NULL)
+            CPLDestroyMutex(_contextMutex);
+        delete _disk;
+    }
+
+    uint64_t SharedTileCache::context(const string& signature) {
+        CPLMutexHolderD(&_contextMutex);
+        map<string, uint64_t>::iterator it = _contexts.find(signature);
+        if (it != _contexts.end())
+            return it->second;
+        _contexts[signature] = _nextContext;
+        _diskPrefixes[_nextContext] = Utils::hashString(signature);
+        return _nextContext++;
+    }
+
+    string SharedTileCache::diskName(const TileKey& key) {
+        if (_disk == NULL)
+            return "";
+        CPLMutexHolderD(&_contextMutex);
+        map<uint64_t, string>::iterator it = _diskPrefixes.find(key.context);
+        if (it == _diskPrefixes.end())
+            return "";
+        stringstream name;
+        name << it->second << "_" << key.id << ".tile";
+        return name.str();
+    }
+
+    uint64_t SharedTileCache::uniqueContext() {
+        CPLMutexHolderD(&_contextMutex);
+        return _nextContext++;
+    }
+
+    bool SharedTileCache::has(const TileKey& key) {
+        int s = shard(key);
+        {
+            CPLMutexHolderD(&_mutexes[s]);
+            if (_shards[s].has(key))
+                return true;
+        }
+        string name = diskName(key);
+        return !name.empty() && _disk->has(name);
+    }
+
+    bool SharedTileCache::read(const TileKey& key, void* dst, size_t size) {
+        int s = shard(key);
+        void* packed = NULL;
+        size_t packedSize = 0, tileSize = 0;
+        {
+            CPLMutexHolderD(&_mutexes[s]);
+            ArrayTile* tile = _shards[s].get(key);
+            if (tile != NULL && tile->storedSize == 0) {
+                memcpy(dst, tile->data, std::min(size, tile->size));
+                return true;
+            }
+            // inflating is much slower than copying, other threads of the shard must not wait for it
+            if (tile != NULL) {
+                packed = malloc(tile->storedSize);
+                packedSize = tile->storedSize;
+                tileSize = tile->size;
+                memcpy(packed, tile->data, packedSize);
+            }
+        }
+        if (packed != NULL) {
+            size_t n = 0;
+            bool ok;
+            if (size >= tileSize) {
+                ok = CPLZLibInflate(packed, packedSize, dst, size, &n) != NULL && n == tileSize;
+            } else {
+                // partial reads need the full tile first
+                void* buf = _pool.acquire(tileSize);
+                ok = CPLZLibInflate(packed, packedSize, buf, tileSize, &n) != NULL && n == tileSize;
+                if (ok)
+                    memcpy(dst, buf, size);
+                _pool.release(buf, tileSize);
+            }
+            free(packed);
+            if (ok)
+                return true;
+            CPLMutexHolderD(&_mutexes[s]);
+            _shards[s].remove(key); // corrupt, should never happen
+        }
+
+        // memory misses fall back to the disk tier, hits are kept in memory again
+        string name = diskName(key);
+        if (name.empty() || !_disk->read(name, dst, size))
+            return false;
+        ArrayTile c;
+        c.id = key.id;
+        c.version = key.version;
+        c.context = key.context;
+        c.size = size;
+        c.data = _pool.acquire(size);
+        memcpy(c.data, dst, size);
+        store(s, c);
+        return true;
+    }
+
+    void SharedTileCache::add(ArrayTile c) {
+        string name = diskName(c.key());
+        if (!name.empty())
+            _disk->write(name, c.data, c.size);
+
+        store(shard(c.key()), c);
+    }
+
+    void SharedTileCache::store(int s, ArrayTile c) {
+        if (_compress) {
+            // compress outside of the lock, keep tiles raw that would not save at least a quarter
+            size_t limit = c.size - c.size / 4;
+            void* buf = malloc(limit);
+            size_t n = 0;
+            if (buf != NULL &&
+                CPLZLibDeflate(c.data, c.size, SCIDB4GDAL_CACHE_COMPRESS_LEVEL, buf, limit, &n) != NULL && n > 0) {
+                _pool.release(c.data, c.size);
+                c.data = realloc(buf, n);
+                c.storedSize = n;
+            } else {
+                free(buf);
             }
-            remove(_q.front());
         }
-        _cache[c.id] = c;
-        _q.push_back(c.id); //
-        _totalSize += c.size;
+
+        bool stored;
+        {
+            CPLMutexHolderD(&_mutexes[s]);
+            stored = _shards[s].add(c);
+        }
+        if (!stored) {
+            if (c.storedSize == 0)
+                _pool.release(c.data, c.size);
+            else
+                free(c.data);
+        }
+    }
+
+    size_t SharedTileCache::maxSize() {
+        size_t total = 0;
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            CPLMutexHolderD(&_mutexes[i]);
+            total += _shards[i].maxSize();
+        }
+        return total;
+    }
+
+    size_t SharedTileCache::maxTileSize() {
+        CPLMutexHolderD(&_mutexes[0]);
+        return _shards[0].maxSize();
+    }
+
+    void SharedTileCache::setMaxSize(size_t bytes) {
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            CPLMutexHolderD(&_mutexes[i]);
+            _shards[i].setMaxSize(bytes / SCIDB4GDAL_CACHE_SHARDS);
+        }
     }
 
-    ArrayTile* TileCache::get(uint32_t id) {
-        if (has(id))
-            return &_cache[id];
-        return NULL;
+    void SharedTileCache::growMaxSize(size_t bytes) {
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            CPLMutexHolderD(&_mutexes[i]);
+            if (_shards[i].maxSize() < bytes / SCIDB4GDAL_CACHE_SHARDS)
+                _shards[i].setMaxSize(bytes / SCIDB4GDAL_CACHE_SHARDS);
+        }
+    }
+
+    string SharedTileCache::stats() {
+        uint64_t hits = 0, misses = 0, evictions = 0;
+        for (int i = 0; i < SCIDB4GDAL_CACHE_SHARDS; ++i) {
+            CPLMutexHolderD(&_mutexes[i]);
+            hits += _shards[i].hits();
+            misses += _shards[i].misses();
+            evictions += _shards[i].evictions();
+        }
+        stringstream s;
+        s << hits << " hits, " << misses << " misses, " << evictions << " evictions, " << _pool.stats();
+        return s.str();
     }
 }
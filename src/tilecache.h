@@ -28,14 +28,59 @@ SOFTWARE.
 #include <iostream>
 #include <sstream>
 #include <list>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
 #include <map>
 #include "utils.h"
+#include "cpl_multiproc.h"
 
-#define SCIDB4GEO_MAXCHUNKCACHE_MB 256
+#define SCIDB4GEO_MAXCHUNKCACHE_MB 256 // default cache size, may be changed with the SCIDB4GDAL_CACHE_MB configuration option
+#define SCIDB4GDAL_CACHE_SHARDS 8 // number of independently locked parts of the process-wide tile cache
+#define SCIDB4GDAL_DISK_CACHE_MB 4096 // default size of the optional disk tier, see SCIDB4GDAL_DISK_CACHE_DIR
+#define SCIDB4GDAL_DISK_CACHE_TMP_AGE 600 // seconds after which unfinished tile files of the disk tier are considered orphaned
+#define SCIDB4GDAL_CACHE_COMPRESS_LEVEL 1 // zlib level of compressed tiles, see SCIDB4GDAL_CACHE_COMPRESS
+#define SCIDB4GDAL_POOL_MAX_MB 64 // maximum size of idle buffers kept for reuse by the buffer pool
 
 namespace scidb4gdal {
     using namespace std;
 
+    /**
+    * @brief Unique key of a cached tile
+    *
+    * Tiles are identified by their block id, the version of the array they have been read from, and a context that
+    * stands for the server, array and opening options, such that tiles of different arrays, array versions or datasets
+    * are never mixed up.
+    */
+    struct TileKey {
+        /** @brief Basic constructor */
+        TileKey(uint64_t id, int64_t version, uint64_t context = 0) : id(id), version(version), context(context) {}
+
+        /** the id of tile / chunk */
+        uint64_t id;
+        /** the array version, 0 if unknown */
+        int64_t version;
+        /** the dataset context as returned by SharedTileCache::context() */
+        uint64_t context;
+
+        bool operator<(const TileKey& k) const {
+            if (context != k.context)
+                return context < k.context;
+            return (version < k.version) || (version == k.version && id < k.id);
+        }
+
+        bool operator==(const TileKey& k) const { return context == k.context && version == k.version && id == k.id; }
+    };
+
+    /** @brief Hash function of tile keys as used by boost::unordered_map */
+    inline size_t hash_value(const TileKey& k) {
+        size_t seed = 0;
+        boost::hash_combine(seed, k.id);
+        boost::hash_combine(seed, k.version);
+        boost::hash_combine(seed, k.context);
+        return seed;
+    }
+
     /**
     * @brief An array tile that is used to represent data of one chunk in SciDB
     *
@@ -44,20 +89,74 @@ namespace scidb4gdal {
     */
     struct ArrayTile {
         /** @brief Basic constructor */
-        ArrayTile() : data(0), size(0), id(0) {}
+        ArrayTile() : data(0), size(0), storedSize(0), id(0), version(0), context(0) {}
         /** the data */
         void* data;
-        /** the size of the data in memory */
+        /** the size of the uncompressed data */
         size_t size;
+        /** the size of the zlib compressed data, 0 if data is not compressed */
+        size_t storedSize;
         /** the id of tile / chunk */
-        uint32_t id;
+        uint64_t id;
+        /** the version of the array the tile has been read from */
+        int64_t version;
+        /** the dataset context, see TileKey */
+        uint64_t context;
+
+        /** @brief Returns the cache key of the tile */
+        TileKey key() const { return TileKey(id, version, context); }
+
+        /** @brief Returns the number of bytes the tile occupies in memory */
+        size_t memSize() const { return storedSize > 0 ? storedSize : size; }
+    };
+
+    /**
+    * @brief A thread-safe pool of reusable buffers of fixed sizes
+    *
+    * Tile buffers of a dataset all have the same size, such that buffers released on eviction or after use can be
+    * reused for the next block instead of being returned to the heap. Idle buffers are kept per size class up to a
+    * total of SCIDB4GDAL_POOL_MAX_MB megabytes, buffers are only kept for sizes that have been acquired before.
+    */
+    class BufferPool {
+    public:
+        BufferPool();
+
+        /** @brief Frees all idle buffers */
+        ~BufferPool();
+
+        /**
+        * @brief Returns an idle buffer of given size or allocates a new one
+        * @param size buffer size in bytes
+        * @return buffer that must be passed to release() or free()
+        */
+        void* acquire(size_t size);
+
+        /**
+        * @brief Returns a buffer to the pool, it is freed if the pool is full or its size has never been acquired
+        * @param data the buffer, may be NULL
+        * @param size buffer size in bytes as passed to acquire()
+        */
+        void release(void* data, size_t size);
+
+        /** @brief Returns allocation and reuse counters as readable string */
+        string stats();
+
+    private:
+        /** idle buffers per size */
+        map<size_t, vector<void*> > _idle;
+        /** total size of idle buffers */
+        size_t _idleSize;
+        /** counters of acquire() calls that needed a new allocation or reused a buffer */
+        uint64_t _allocations, _reuses;
+        CPLMutex* _mutex;
     };
 
     /**
     * @brief A cache for various chunks of an SciDB array.
     *
     * This class caches tiles that were read from SciDB by gdal locally. Because some formats that are line- or stripe oriented require to read a whole line
-    * in order to run efficiently.
+    * in order to run efficiently. If the cache is full, least recently used tiles are removed first. All operations take
+    * constant time.
     */
     class TileCache {
     public:
@@ -72,32 +171,36 @@ namespace scidb4gdal {
         ~TileCache();
 
         /**
-        * @brief Checks whether a tile with given id is already cached
-        * @param id unique tile id
+        * @brief Checks whether a tile with given key is already cached
+        * @param key unique tile key
         * @return true if tile is in cached
         */
-        bool has(uint32_t id);
+        bool has(const TileKey& key);
 
         /**
-        * @brief Removes a tile with given id from cache
-        * @param id unique tile id
+        * @brief Removes a tile with given key from cache
+        * @param key unique tile key
         */
-        void remove(uint32_t id);
+        void remove(TileKey key);
 
         /**
         * @brief add a tile to the cache
         * @param c the tile to be cached including its data pointer, size in bytes,
         * and unique id
+        * @return true if the cache took ownership of the tile's data, false if the tile is cached already or too large
         */
-        void add(ArrayTile c);
+        bool add(ArrayTile c);
 
         /**
-        * @brief Fetches a tile with given id from the cache
-        * @param id unique tile id
+        * @brief Fetches a tile with given key from the cache
+        *
+        * The tile becomes the most recently used one. Calls are counted as hit or miss.
+        *
+        * @param key unique tile key
         * @return Pointer to the requested tile including its data pointer, size in
         * bytes, and unique id or null pointer if tile is not in cache
         */
-        ArrayTile* get(uint32_t id);
+        ArrayTile* get(const TileKey& key);
 
         /**
         * @brief Clears the cache
@@ -111,7 +214,8 @@ namespace scidb4gdal {
         /**
         * @brief calculates unique tile id
         *
-        * Function for computing unique tile ids for two-dimensional multiband images
+        * Function for computing unique tile ids for two-dimensional multiband images. Ids are computed with 64 bit
+        * integers, such that they do not alias for large images with many bands.
         *
         * @param bx specific tile index in x direction
         * @param by specific tile index in y direction
@@ -121,9 +225,9 @@ namespace scidb4gdal {
         * @param nband total number of bands
         * @return unique id
         */
-        static inline uint32_t getBlockId(int bx, int by, int band, int nx, int ny,
-                                        int nband) {
-            return (band * nx * ny) + (by * nx) + (bx);
+        static inline uint64_t getBlockId(int64_t bx, int64_t by, int64_t band, int64_t nx, int64_t ny,
+                                          int64_t nband) {
+            return (uint64_t)((band * nx * ny) + (by * nx) + (bx));
         }
 
         /**
@@ -132,15 +236,232 @@ namespace scidb4gdal {
         */
         inline size_t freeSpace() { return _maxSize - _totalSize; }
 
+        /**
+        * @brief Returns the maximum size of the cache in bytes
+        */
+        inline size_t maxSize() const { return _maxSize; }
+
+        /**
+        * @brief Changes the maximum size of the cache, least recently used tiles are removed if needed
+        * @param bytes new maximum size in bytes
+        */
+        void setMaxSize(size_t bytes);
+
+        /** @brief Number of get() calls that found the requested tile */
+        inline uint64_t hits() const { return _hits; }
+        /** @brief Number of get() calls that did not find the requested tile */
+        inline uint64_t misses() const { return _misses; }
+        /** @brief Number of tiles removed to make room for others */
+        inline uint64_t evictions() const { return _evictions; }
+
+        /**
+        * @brief Sets a pool that receives the buffers of removed uncompressed tiles, instead of freeing them
+        * @param pool buffer pool, NULL to free buffers
+        */
+        inline void setPool(BufferPool* pool) { _pool = pool; }
+
     private:
-        /** the total size of the cached image */
+        /** @brief A cached tile and its position in the usage order */
+        struct Entry {
+            ArrayTile tile;
+            list<TileKey>::iterator pos;
+        };
+
+        /** the total size of the cached image in memory, i.e. compressed sizes of compressed tiles */
         size_t _totalSize;
         /** the maximum size that is reserved */
         size_t _maxSize;
         /** a look up table to relate unique ids and the array tile that is referred to */
-        map<uint32_t, ArrayTile>  _cache;  // TODO: unordered_map would be more efficient but C++11
-        /** order of insertions for removing oldes first */
-        list<uint32_t> _q;
+        boost::unordered_map<TileKey, Entry> _cache;
+        /** usage order, most recently used tiles first */
+        list<TileKey> _lru;
+        /** usage counters */
+        uint64_t _hits, _misses, _evictions;
+        /** pool of released buffers, may be NULL */
+        BufferPool* _pool;
+    };
+
+    /**
+    * @brief Persistent tile files in a directory, shared by subsequent processes
+    *
+    * Tiles are stored as one file each and written to a temporary file first, which is renamed when complete, such
+    * that crashed or concurrent writers never leave partial tiles behind. The directory size is bounded, least recently
+    * used files are removed first. Usage order is initialized from file modification times when the cache is created.
+    */
+    class DiskTileCache {
+    public:
+        /**
+        * @brief Creates the directory if needed and indexes existing tile files
+        * @param dir cache directory
+        * @param maxSize maximum size of all tile files in bytes
+        */
+        DiskTileCache(const string& dir, size_t maxSize);
+
+        ~DiskTileCache();
+
+        /**
+        * @brief Checks whether a tile file exists, including files written by other processes since the last scan
+        * @param name file name of the tile
+        */
+        bool has(const string& name);
+
+        /**
+        * @brief Reads a tile file
+        * @param name file name of the tile
+        * @param dst destination buffer
+        * @param size expected size of the tile in bytes, files of different size are removed
+        * @return true if the tile has been read
+        */
+        bool read(const string& name, void* dst, size_t size);
+
+        /**
+        * @brief Writes a tile file, removing least recently used files if needed
+        * @param name file name of the tile
+        * @param data tile data
+        * @param size size of the tile in bytes
+        */
+        void write(const string& name, const void* data, size_t size);
+
+    private:
+        /** @brief Moves a known file to the end of the usage order, the mutex must be held */
+        void touch(const string& name);
+        /** @brief Removes a file from disk and index, the mutex must be held */
+        void remove(const string& name);
+        /**
+        * @brief Updates the index with files written or removed by other processes, the mutex must be held
+        * @param startup whether to remove orphaned temporary files as well
+        */
+        void scan(bool startup);
+
+        string _dir;
+        size_t _maxSize;
+        size_t _totalSize;
+        /** file sizes and positions in the usage order */
+        boost::unordered_map<string, pair<size_t, list<string>::iterator> > _files;
+        /** usage order, least recently used files first */
+        list<string> _lru;
+        CPLMutex* _mutex;
+    };
+
+    /**
+    * @brief A thread-safe tile cache shared by all datasets of the process
+    *
+    * Datasets that read the same array version with the same options share a context, such that reopening an array
+    * finds its tiles warm. The byte budget applies to the whole process and is split among SCIDB4GDAL_CACHE_SHARDS
+    * TileCache instances, each with its own mutex, to keep lock contention of parallel readers low. If the configuration
+    * option SCIDB4GDAL_DISK_CACHE_DIR is set, tiles of shared contexts are additionally written to a DiskTileCache of
+    * SCIDB4GDAL_DISK_CACHE_MB megabytes, which is consulted on memory misses.
+    *
+    * If the configuration option SCIDB4GDAL_CACHE_COMPRESS is enabled, tiles are held zlib compressed in memory, which
+    * lets nodata-heavy or smooth tiles, e.g. masks or elevation models, take a fraction of their raw size. Tiles that do
+    * not compress well are stored raw.
+    */
+    class SharedTileCache {
+    public:
+        /**
+        * @brief Returns the process-wide instance, created on first use
+        *
+        * The size is read from the SCIDB4GDAL_CACHE_MB configuration option and defaults to SCIDB4GEO_MAXCHUNKCACHE_MB.
+        */
+        static SharedTileCache& instance();
+
+        /**
+        * @brief Releases the process-wide instance and all cached tiles, called when the driver is unloaded
+        */
+        static void destroy();
+
+        /**
+        * @brief Returns the context id for a dataset signature, equal signatures get equal ids
+        * @param signature string describing server, array, version and all options that affect tile contents
+        */
+        uint64_t context(const string& signature);
+
+        /**
+        * @brief Returns a new context id that is never shared, e.g. for arrays without versions whose contents may change
+        *
+        * Tiles of unique contexts are never written to disk.
+        */
+        uint64_t uniqueContext();
+
+        /** @copydoc TileCache::has */
+        bool has(const TileKey& key);
+
+        /**
+        * @brief Copies a cached tile to a buffer
+        * @param key unique tile key
+        * @param dst destination buffer
+        * @param size number of bytes to be copied, must not exceed the tile size
+        * @return true if the tile is cached, compressed tiles are decompressed directly into dst
+        */
+        bool read(const TileKey& key, void* dst, size_t size);
+
+        /**
+        * @brief Adds a tile to the cache, the cache always takes ownership of its data and releases it if not stored
+        *
+        * Tile data should be allocated with pool().acquire().
+        * @param c the tile to be cached
+        */
+        void add(ArrayTile c);
+
+        /** @brief Returns the total size of the cache in bytes */
+        size_t maxSize();
+
+        /** @brief Returns the size of the largest cacheable tile in bytes */
+        size_t maxTileSize();
+
+        /**
+        * @brief Changes the total size of the cache
+        * @param bytes new size in bytes
+        */
+        void setMaxSize(size_t bytes);
+
+        /**
+        * @brief Enlarges the cache to at least the given size, it is never shrunk
+        * @param bytes minimum size in bytes
+        */
+        void growMaxSize(size_t bytes);
+
+        /** @brief Returns hit, miss and eviction counters summed over all shards as readable string */
+        string stats();
+
+        /** @brief Returns the pool of tile sized buffers, which also receives buffers of evicted tiles */
+        inline BufferPool& pool() { return _pool; }
+
+    private:
+        SharedTileCache();
+        ~SharedTileCache();
+
+        /** @brief Returns the shard index of a key */
+        inline int shard(const TileKey& key) const { return (int)(hash_value(key) % SCIDB4GDAL_CACHE_SHARDS); }
+
+        /**
+        * @brief Compresses a tile if enabled and adds it to a shard, takes ownership of its data
+        * @param s shard index
+        * @param c the tile to be cached
+        */
+        void store(int s, ArrayTile c);
+
+        /** @brief Returns the file name of a tile in the disk tier, empty if its context is not persistent */
+        string diskName(const TileKey& key);
+
+        /** reusable tile buffers */
+        BufferPool _pool;
+        /** whether or not tiles are compressed in memory */
+        bool _compress;
+        /** the optional disk tier, NULL if not configured */
+        DiskTileCache* _disk;
+        /** stable names of shared contexts as used for tile files, hashed from their signatures */
+        map<uint64_t, string> _diskPrefixes;
+
+        TileCache _shards[SCIDB4GDAL_CACHE_SHARDS];
+        CPLMutex* _mutexes[SCIDB4GDAL_CACHE_SHARDS];
+        /** interned dataset signatures */
+        map<string, uint64_t> _contexts;
+        uint64_t _nextContext;
+        CPLMutex* _contextMutex;
+
+        static SharedTileCache* _instance;
+        static CPLMutex* _instanceMutex;
     };
 };
 
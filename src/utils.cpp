@@ -25,6 +25,7 @@ SOFTWARE.
 #include "utils.h"
 #include <ctime>
 #include <sstream>
+#include <iomanip>
 #include <cctype>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
@@ -279,5 +280,16 @@ namespace scidb4gdal {
             return out;
         }
 
+        string hashString(const string& s) {
+            uint64_t h = 14695981039346656037ULL;
+            for (size_t i = 0; i < s.length(); ++i) {
+                h ^= (uint8_t)s[i];
+                h *= 1099511628211ULL;
+            }
+            stringstream out;
+            out << std::hex << std::setw(16) << std::setfill('0') << h;
+            return out.str();
+        }
+
     }
 }
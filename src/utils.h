@@ -37,18 +37,24 @@ SOFTWARE.
 //#define SCIDB4GDAL_DEFAULT_BLOCKSIZE_Y 512
 
 #define SCIDB4GDAL_DEFAULT_BLOCKSIZE 512
+#define SCIDB4GDAL_DEFAULT_REQUEST_MB 4 // targeted size of automatically chosen blocks
 #define SCIDB4GDAL_DEFAULT_TDIM_BLOCKSIZE 1
 #define SCIDB4GEO_DEFAULT_CHUNKSIZE_MB 32  // This is an upper limit, SciDB recommends smaller chunks ~ 10 MB, but for ingestion and download, larger chunks turned out to be faster.
 
 #define SCIDB4GDAL_DEFAULT_UPLOAD_FILENAME "scidb4gdal_temp.bin"
+#define SCIDB4GDAL_DEFAULT_UPLOAD_CHUNKSIZE 1048576 // cells per chunk of one-dimensional uploads, e.g. zone rasters
 #define SCIDB4GDAL_ARRAYSUFFIX_TEMP "_temp"
 #define SCIDB4GDAL_ARRAYSUFFIX_TEMPLOAD "_tempload"
 #define SCIDB4GDAL_ARRAYSUFFIX_COLLECTION_INTEGRATION "_integrate"
+#define SCIDB4GDAL_ARRAYPREFIX_QUERY "scidb4gdal_query_" // materialized results of SCIDB:query=... datasets
 
 //#define SCIDB4GDAL_ARRAY_PREFIX "GDAL_" // Names of created arrays get a prefix, not yet implemented
 
 #define SCIDB4GDAL_MAINMEM_HARD_LIMIT_MB 1024
 
+#define SCIDB4GDAL_COALESCE_MAX_BLOCKS 16 // maximum number of adjacent blocks of a row that are fetched with one query
+#define SCIDB4GDAL_OCCUPANCY_REGION_BLOCKS 32 // block occupancy is loaded lazily for regions of n x n blocks
+
 #define SCIDB_MAX_DIM_INDEX 4611686018427387903             //  same as 1 << 62 - 1
 
 #define SCIDB4GDAL_DEFAULTNODATA_INT8 -pow(2, 7)
@@ -70,6 +76,11 @@ SOFTWARE.
 #define SCIDB4GDAL_DEFAULTMDFIELD_MAX     "MAX"
 #define SCIDB4GDAL_DEFAULTMDFIELD_MIN     "MIN"
 
+#define SCIDB4GDAL_MDDOMAIN_DRILL "DRILL" // metadata domain for time series requests on spacetime arrays
+#define SCIDB4GDAL_MDDOMAIN_POINTS "POINTS" // metadata domain for batched point value requests
+#define SCIDB4GDAL_MDDOMAIN_ZONES "ZONES" // metadata domain for zonal statistics of a zone raster
+#define SCIDB4GDAL_MDDOMAIN_TINDEX "SCIDB4GDAL_TINDEX" // array metadata domain of the stored temporal occupancy index
+
 #include <string>
 #include <iostream>
 #include <vector>
@@ -303,6 +314,14 @@ namespace scidb4gdal {
     * @return string parts between the found separator 
     */
     std::vector<std::string> split(const std::string& s, const std::string& sep);
+
+    /**
+    * @brief Computes a 64 bit FNV-1a hash of a string
+    *
+    * @param s string to be hashed
+    * @return hexadecimal representation of the hash with 16 characters
+    */
+    std::string hashString(const std::string& s);
     
         
     }
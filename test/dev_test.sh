@@ -16,6 +16,24 @@ function check {
   fi
 }
 
+#band checksums of a raster, one line per band
+function checksums {
+  gdalinfo -checksum "$1" | grep "^  Checksum=" | sed 's/.*Checksum=//'
+}
+
+#compares the output of a feature with the output of the plain read path
+function check_same {
+  echo "comparing checksums of $1 and $2"
+  local a=$(checksums "$1")
+  local b=$(checksums "$2")
+  if [ -n "$a" ] && [ "$a" == "$b" ];
+    then
+      check 0
+    else
+      check 1
+  fi
+}
+
 #download chicago black-white geotiff image
 chicago="./UTM2GTIF.TIF"
 if (! test -f ${chicago})
@@ -51,6 +69,7 @@ targetArraySCov=test_chicago_s_cov
 targetArraySTSCov=test_chicago_sts_cov
 targetArrayConEnv=test_chicago_con_env
 target_var_chunk=test_chicago_chunk
+targetArrayWarm=test_chicago_warm
 
 #output file names
 rm -f ./test_*.tif
@@ -65,6 +84,19 @@ outputSMetaNA="./test_s_meta_na.tif"
 outputSCov="./test_s_cov.tif"
 outputSTSCov1="./test_sts_cov1.tif"
 outputSTSCov2="./test_sts_cov2.tif"
+outputSTSInterval="./test_sts_interval.tif"
+outputSTSReducer="./test_sts_reducer.tif"
+outputSApply="./test_s_apply.tif"
+outputSCast="./test_s_cast.tif"
+outputSFilter="./test_s_filter.tif"
+outputSQuery="./test_s_query.tif"
+outputSJoin="./test_s_join.tif"
+outputSMask="./test_s_mask.tif"
+outputSVersion="./test_s_version.tif"
+outputSBlocksize="./test_s_blocksize.tif"
+outputSCovAlign="./test_s_cov_align.tif"
+outputSWarm="./test_s_warm.tif"
+zones="./test_zones.tif"
 
 #create a log file
 log="./test.log"
@@ -182,6 +214,9 @@ time {
   echo gdalmanage delete \"SCIDB:array=${targetArrayNACov} confirmDelete=y\"
   gdalmanage delete "SCIDB:array=${target_var_chunk} confirmDelete=y"
   echo ""
+  echo gdalmanage delete \"SCIDB:array=${targetArrayWarm} confirmDelete=y\"
+  gdalmanage delete "SCIDB:array=${targetArrayWarm} confirmDelete=y"
+  echo ""
 }
 echo "" 
 echo "###########################################"
@@ -479,6 +514,186 @@ time {
 }
 echo ""
 
+echo "" 
+echo "##########################################################"
+echo "# Reading with analysis and performance options"
+echo "##########################################################"
+echo "" 
+#each output is compared with the plain read of the same cells above
+TIMEFORMAT='Data retrieval took %R seconds'
+
+time {
+  echo "***** Downloading the second slice of a temporal interval"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -b 2 -oo \"t=2015-10-15/2015-10-20\" -of GTiff \"SCIDB:array=${targetArraySTS}\" ${outputSTSInterval}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -b 2 -oo "t=2015-10-15/2015-10-20" -of GTiff "SCIDB:array=${targetArraySTS}" ${outputSTSInterval}
+  check $?
+  check_same ${outputSTSInterval} ${outputSTS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading the median composite of identical slices"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -ot Byte -oo \"t=2015-10-15/2015-10-20\" -oo \"reducer=median\" -of GTiff \"SCIDB:array=${targetArraySTS}\" ${outputSTSReducer}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -ot Byte -oo "t=2015-10-15/2015-10-20" -oo "reducer=median" -of GTiff "SCIDB:array=${targetArraySTS}" ${outputSTSReducer}
+  check $?
+  check_same ${outputSTSReducer} ${outputSTS2}
+}
+echo ""
+
+time {
+  echo "***** Drilling a pixel time series, all slices hold the same image"
+  python3 - "SCIDB:array=${targetArraySTS}" ${outputSTS2} <<'EOF'
+import sys
+from osgeo import gdal
+series = gdal.Open(sys.argv[1]).GetRasterBand(1).GetMetadataItem("Pixel_100_100", "DRILL")
+plain = gdal.Open(sys.argv[2]).GetRasterBand(1).ReadAsArray(100, 100, 1, 1)[0][0]
+lines = [l for l in (series or "").splitlines() if l]
+print(series)
+sys.exit(0 if len(lines) == 3 and all(float(l.split(",")[1]) == plain for l in lines) else 1)
+EOF
+  check $?
+}
+echo ""
+
+time {
+  echo "***** Downloading a derived band"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -oo \"apply=v:band1\" -of GTiff \"SCIDB:array=${targetArray}\" ${outputSApply}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -oo "apply=v:band1" -of GTiff "SCIDB:array=${targetArray}" ${outputSApply}
+  check $?
+  check_same ${outputSApply} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading a double band into a Byte buffer, which is converted in the database"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -ot Byte -oo \"apply=v:double\(band1\)\" -of GTiff \"SCIDB:array=${targetArray}\" ${outputSCast}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -ot Byte -oo "apply=v:double(band1)" -of GTiff "SCIDB:array=${targetArray}" ${outputSCast}
+  check $?
+  check_same ${outputSCast} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading with a filter that all cells pass"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -oo \"filter=band1\>=0\" -of GTiff \"SCIDB:array=${targetArray}\" ${outputSFilter}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -oo "filter=band1>=0" -of GTiff "SCIDB:array=${targetArray}" ${outputSFilter}
+  check $?
+  check_same ${outputSFilter} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading the result of an AFL query"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -of GTiff \"SCIDB:query=filter\(${targetArray},true\)\" ${outputSQuery}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -of GTiff "SCIDB:query=filter(${targetArray},true)" ${outputSQuery}
+  check $?
+  check_same ${outputSQuery} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading the second band of two joined arrays"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -b 2 -of GTiff \"SCIDB:array=${targetArray},${targetArrayConEnv}\" ${outputSJoin}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -b 2 -of GTiff "SCIDB:array=${targetArray},${targetArrayConEnv}" ${outputSJoin}
+  check $?
+  check_same ${outputSJoin} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading image with NA values and a mask band"
+  echo gdal_translate --debug ON -oo \"mask=true\" -of GTiff \"SCIDB:array=${targetArrayMetaNA}\" ${outputSMask}
+  gdal_translate --debug ON -oo "mask=true" -of GTiff "SCIDB:array=${targetArrayMetaNA}" ${outputSMask}
+  check $?
+  check_same ${outputSMask} ${outputSMetaNA}
+}
+echo ""
+
+time {
+  echo "***** Downloading a pinned array version"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -oo \"version=1\" -of GTiff \"SCIDB:array=${targetArray}\" ${outputSVersion}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -oo "version=1" -of GTiff "SCIDB:array=${targetArray}" ${outputSVersion}
+  check $?
+  check_same ${outputSVersion} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading with a fixed block size"
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -oo \"blocksize=64\" -of GTiff \"SCIDB:array=${targetArray}\" ${outputSBlocksize}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -oo "blocksize=64" -of GTiff "SCIDB:array=${targetArray}" ${outputSBlocksize}
+  check $?
+  check_same ${outputSBlocksize} ${outputS2}
+}
+echo ""
+
+time {
+  echo "***** Downloading the coverage padded to chunk boundaries"
+  echo gdal_translate --debug ON -oo \"align=true\" -of GTiff \"SCIDB:array=${targetArraySCov}\" ${outputSCovAlign}
+  gdal_translate --debug ON -oo "align=true" -of GTiff "SCIDB:array=${targetArraySCov}" ${outputSCovAlign}
+  check $?
+  python3 - ${outputSCovAlign} ${outputSCov} <<'EOF'
+import sys
+from osgeo import gdal
+aligned, plain = gdal.Open(sys.argv[1]), gdal.Open(sys.argv[2])
+ga, gp = aligned.GetGeoTransform(), plain.GetGeoTransform()
+dx, dy = int(round((gp[0] - ga[0]) / ga[1])), int(round((gp[3] - ga[3]) / ga[5]))
+w, h = plain.RasterXSize, plain.RasterYSize
+same = aligned.GetRasterBand(1).ReadRaster(dx, dy, w, h) == plain.GetRasterBand(1).ReadRaster(0, 0, w, h)
+sys.exit(0 if same else 1)
+EOF
+  check $?
+}
+echo ""
+
+time {
+  echo "***** Extracting point values with one query"
+  python3 - "SCIDB:array=${targetArray}" ${outputS2} <<'EOF'
+import sys
+from osgeo import gdal
+plain = gdal.Open(sys.argv[2])
+gt = plain.GetGeoTransform()
+pixels = [(10, 20), (150, 40), (199, 199)]
+points = " ".join("%.6f,%.6f" % (gt[0] + (x + 0.5) * gt[1], gt[3] + (y + 0.5) * gt[5]) for x, y in pixels)
+result = gdal.Open(sys.argv[1]).GetRasterBand(1).GetMetadataItem(points, "POINTS")
+print(result)
+values = [float(l.split(",")[2]) for l in (result or "").splitlines() if l]
+expected = [float(plain.GetRasterBand(1).ReadAsArray(x, y, 1, 1)[0][0]) for x, y in pixels]
+sys.exit(0 if values == expected else 1)
+EOF
+  check $?
+}
+echo ""
+
+time {
+  echo "***** Computing zonal statistics of a single zone covering the image"
+  echo gdal_translate -ot Byte -scale 0 255 1 1 -a_nodata none ${outputSMetaNA} ${zones}
+  gdal_translate -ot Byte -scale 0 255 1 1 -a_nodata none ${outputSMetaNA} ${zones}
+  python3 - "SCIDB:array=${targetArrayMetaNA}" ${outputSMetaNA} ${zones} <<'EOF'
+import sys
+from osgeo import gdal
+result = gdal.Open(sys.argv[1]).GetRasterBand(1).GetMetadataItem(sys.argv[3], "ZONES")
+print(result)
+zone = [l.split(",") for l in (result or "").splitlines() if l.startswith("1,")]
+mean = gdal.Open(sys.argv[2]).GetRasterBand(1).ComputeStatistics(False)[2]
+sys.exit(0 if len(zone) == 1 and abs(float(zone[0][3]) - mean) < 1e-6 * abs(mean) else 1)
+EOF
+  check $?
+}
+echo ""
+
+time {
+  echo "***** Uploading with a warm tile cache and reading back statistics"
+  echo gdal_translate --debug ON -co \"type=S\" -co \"warm_cache=true\" -stats -of SciDB ${chicago} \"SCIDB:array=${targetArrayWarm}\"
+  gdal_translate --debug ON -co "type=S" -co "warm_cache=true" -stats -of SciDB "${chicago}" "SCIDB:array=${targetArrayWarm}"
+  check $?
+  echo gdal_translate --debug ON -srcwin 0 0 200 200 -of GTiff \"SCIDB:array=${targetArrayWarm}\" ${outputSWarm}
+  gdal_translate --debug ON -srcwin 0 0 200 200 -of GTiff "SCIDB:array=${targetArrayWarm}" ${outputSWarm}
+  check $?
+  check_same ${outputSWarm} ${outputS2}
+}
+echo ""
+
 echo "Test results. ${SUCCESS} successful tests / ${FAILED} failed tests."
 echo ""
 